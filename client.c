@@ -1,6 +1,7 @@
 // client.c
 // #llm generated code begins
 #define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64     // files over 2 GB on 32-bit builds too
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,80 +10,306 @@
 #include <errno.h>
 #include <time.h>
 #include <sys/time.h>
-#include <sys/socket.h>
-#include <arpa/inet.h>
-#include <fcntl.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <netdb.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <dirent.h>
+#include <arpa/inet.h>
 #include <openssl/md5.h>
-#include <stdarg.h>
-#include <sys/select.h>
 
 #include "sham.h"
+#include "sham_chat.h"
+#include "sham_file.h"
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+#define FASTOPEN_CACHE ".sham_cookies"
 
-#define RTO_MS 500
-#define SND_WND_PACKETS 10
-#define MAX_SENT_SLOTS 128
+// One file of a transfer: local path, name on the server, and its outcome
+struct xfer_file {
+    char *path;
+    char *name;
+    uint64_t size;
+    unsigned char md5[MD5_DIGEST_LENGTH];
+    bool sent;             // record header went out
+    bool changed;          // file shrank while being read; zero-padded to size
+};
+
+struct xfer {
+    struct xfer_file *files;
+    size_t nfiles, cap;
+    bool batch;
+    // record encoder
+    size_t cur;
+    FILE *fp;
+    uint64_t left;
+    MD5_CTX md5;
+    // per-file results coming back from the server
+    char rbuf[SHAM_FILE_NAME_MAX + 64];
+    size_t rlen;
+    size_t next_result, nok, nbad;
+};
 
-static FILE *log_file = NULL;
-static int logging_enabled = 0;
+static void add_file(struct xfer *x, const char *path, const char *name) {
+    struct stat sb;
+    if (stat(path, &sb) < 0 || !S_ISREG(sb.st_mode)) {
+        fprintf(stderr, "Skipping %s: not a regular file\n", path);
+        return;
+    }
+    if (name[0] == '\0' || strlen(name) > SHAM_FILE_NAME_MAX) {
+        fprintf(stderr, "Skipping %s: bad output name\n", path);
+        return;
+    }
+    if (x->nfiles == x->cap) {
+        x->cap = x->cap ? 2 * x->cap : 16;
+        x->files = realloc(x->files, x->cap * sizeof(*x->files));
+        if (!x->files) { perror("realloc"); exit(1); }
+    }
+    struct xfer_file *f = &x->files[x->nfiles++];
+    memset(f, 0, sizeof(*f));
+    f->path = strdup(path);
+    f->name = strdup(name);
+    f->size = (uint64_t)sb.st_size;
+}
 
-static void open_log(const char *name) {
-    char *env = getenv("RUDP_LOG");
-    if (env && strcmp(env, "1") == 0) {
-        logging_enabled = 1;
-        log_file = fopen(name, "w");
+// Every regular file below dir, named name/<relative path> on the server
+static void add_dir(struct xfer *x, const char *dir, const char *name) {
+    DIR *d = opendir(dir);
+    if (!d) { perror(dir); return; }
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        char path[4096], rname[SHAM_FILE_NAME_MAX + 2];
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        snprintf(rname, sizeof(rname), "%s/%s", name, e->d_name);
+        struct stat sb;
+        if (lstat(path, &sb) < 0) continue;   // symlinks are not followed
+        if (S_ISDIR(sb.st_mode)) add_dir(x, path, rname);
+        else if (S_ISREG(sb.st_mode)) add_file(x, path, rname);
     }
+    closedir(d);
 }
-static void close_log(void) {
-    if (log_file) fclose(log_file);
-    log_file = NULL;
-    logging_enabled = 0;
+
+// Manifest: one "<input_file> [<output_file_name>]" per line, # starts a comment
+static int add_manifest(struct xfer *x, const char *manifest) {
+    FILE *mf = fopen(manifest, "r");
+    if (!mf) { perror(manifest); return -1; }
+    char line[4096];
+    while (fgets(line, sizeof(line), mf)) {
+        char *save = NULL;
+        char *in = strtok_r(line, " \t\r\n", &save);
+        if (!in || in[0] == '#') continue;
+        char *out = strtok_r(NULL, " \t\r\n", &save);
+        add_file(x, in, out ? out : in);
+    }
+    fclose(mf);
+    return 0;
 }
-static void timestamped_log(const char *fmt, ...) {
-    if (!logging_enabled || !log_file) return;
-    struct timeval tv; gettimeofday(&tv, NULL);
-    time_t cur = tv.tv_sec;
-    struct tm *tm = localtime(&cur);
-    char timebuf[64];
-    strftime(timebuf, sizeof(timebuf), "%Y-%m-%d %H:%M:%S", tm);
-    fprintf(log_file, "[%s.%06ld] [LOG] ", timebuf, (long)tv.tv_usec);
-    va_list ap; va_start(ap, fmt); vfprintf(log_file, fmt, ap); va_end(ap);
-    fprintf(log_file, "\n"); fflush(log_file);
+
+static void md5_hex(const unsigned char *md5, char *hex) {
+    for (int i = 0; i < MD5_DIGEST_LENGTH; ++i) sprintf(hex + 2 * i, "%02x", md5[i]);
 }
 
-static void sleep_ms(int ms) {
-    struct timespec ts = { ms/1000, (ms%1000) * 1000000L };
-    nanosleep(&ts, NULL);
+// Produce the next bytes of the record stream; 0 once every file is out.
+// Records run back to back, so small files end up sharing segments.
+static size_t xfer_fill(struct xfer *x, char *buf, size_t cap) {
+    size_t used = 0;
+    while (used < cap && x->cur < x->nfiles) {
+        struct xfer_file *f = &x->files[x->cur];
+        if (!x->fp) {
+            size_t nlen = strlen(f->name);
+            if (cap - used < sizeof(struct sham_file_hdr) + nlen) break;
+            x->fp = fopen(f->path, "rb");
+            if (!x->fp) { perror(f->path); x->nbad++; x->cur++; continue; }
+            struct sham_file_hdr hdr;
+            hdr.magic = htonl(SHAM_FILE_MAGIC);
+            hdr.name_len = htons((uint16_t)nlen);
+            hdr.flags = htons(x->batch ? SHAM_FILE_BATCH : 0);
+            hdr.size_hi = htonl((uint32_t)(f->size >> 32));
+            hdr.size_lo = htonl((uint32_t)f->size);
+            memcpy(buf + used, &hdr, sizeof(hdr));
+            memcpy(buf + used + sizeof(hdr), f->name, nlen);
+            used += sizeof(hdr) + nlen;
+            x->left = f->size;
+            MD5_Init(&x->md5);
+            f->sent = true;
+            sham_log("SND FILENAME %s", f->name);
+        }
+        size_t want = x->left < cap - used ? (size_t)x->left : cap - used;
+        size_t r = want ? fread(buf + used, 1, want, x->fp) : 0;
+        if (r < want) {
+            // The size is already on the wire: pad so the next record lines up
+            memset(buf + used + r, 0, want - r);
+            f->changed = true;
+        }
+        MD5_Update(&x->md5, buf + used, want);
+        used += want;
+        x->left -= want;
+        if (x->left == 0) {
+            MD5_Final(f->md5, &x->md5);
+            fclose(x->fp);
+            x->fp = NULL;
+            x->cur++;
+        }
+    }
+    return used;
 }
-static long long now_ms(void) {
-    struct timeval tv; gettimeofday(&tv, NULL);
-    return (long long)tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+
+// Match one "OK <md5> <name>" / "ERR - <name>" line to the next file sent
+static void xfer_result(struct xfer *x, const char *line) {
+    while (x->next_result < x->nfiles && !x->files[x->next_result].sent) x->next_result++;
+    if (x->next_result == x->nfiles) return;
+    struct xfer_file *f = &x->files[x->next_result++];
+    char hex[2 * MD5_DIGEST_LENGTH + 1];
+    md5_hex(f->md5, hex);
+    bool ok = strncmp(line, "OK ", 3) == 0 && strncmp(line + 3, hex, 2 * MD5_DIGEST_LENGTH) == 0 && !f->changed;
+    if (ok) x->nok++;
+    else x->nbad++;
+    printf("%-6s %s  %s\n", ok ? "OK" : "FAILED", hex, f->name);
 }
-static int create_udp_socket(void) {
-    int s = socket(AF_INET, SOCK_DGRAM, 0);
-    if (s < 0) { perror("socket"); exit(1); }
-    return s;
+
+// Consume whatever results have arrived; returns sham_recv()'s last value
+static ssize_t read_results(struct sham_conn *conn, struct xfer *x) {
+    ssize_t n;
+    while ((n = sham_recv(conn, x->rbuf + x->rlen, sizeof(x->rbuf) - 1 - x->rlen)) > 0) {
+        x->rlen += (size_t)n;
+        size_t start = 0;
+        for (size_t i = 0; i < x->rlen; ++i) {
+            if (x->rbuf[i] != '\n') continue;
+            x->rbuf[i] = '\0';
+            xfer_result(x, x->rbuf + start);
+            start = i + 1;
+        }
+        memmove(x->rbuf, x->rbuf + start, x->rlen - start);
+        x->rlen -= start;
+        if (x->rlen == sizeof(x->rbuf) - 1) x->rlen = 0;   // overlong line, drop it
+    }
+    return n;
 }
-static ssize_t safe_sendto(int sock, const void *buf, size_t len, int flags,
-                           const struct sockaddr *dest_addr, socklen_t addrlen) {
-    ssize_t r = sendto(sock, buf, len, flags, dest_addr, addrlen);
-    if (r < 0) perror("sendto");
-    return r;
+
+// Wait for the next protocol event and collect results meanwhile. The server
+// answers while we are still sending, so results are always drained.
+static void pump(struct sham_conn *conn, struct xfer *x) {
+    struct pollfd pfd = { sham_fd(conn), POLLIN, 0 };
+    int t = sham_timeout_ms(conn);
+    poll(&pfd, 1, t >= 0 && t < 1000 ? t : 1000);
+    sham_process(conn);
+    read_results(conn, x);
 }
 
-struct sent_slot {
-    int in_use;
-    struct sham_packet pkt;
-    ssize_t len;
-    long long sent_time_ms;
-};
+static int xfer_send(struct sham_conn *conn, struct xfer *x, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = sham_send(conn, buf, len);
+        if (n > 0) { buf += n; len -= (size_t)n; continue; }
+        if (errno != EAGAIN) return -1;
+        pump(conn, x);
+    }
+    return 0;
+}
+
+// Send every file of x over a single connection: one handshake and one
+// close for the whole set, records pipelined back to back.
+static int run_file(const char *server_ip, int server_port, const struct sham_opts *opts, struct xfer *x) {
+    if (x->nfiles == 0) { fprintf(stderr, "Nothing to send\n"); return 1; }
+
+    // The first records are handed over with the connect so that in
+    // fast-open mode they ride in the SYN.
+    char data_buf[16 * SHAM_PAYLOAD];
+    size_t r = xfer_fill(x, data_buf, sizeof(data_buf));
+    bool eof = x->cur == x->nfiles;
+    if (r == 0) return 1;   // none of the files could be opened
+
+    struct sham_conn *conn = sham_connect_data(server_ip, (uint16_t)server_port, opts,
+                                               data_buf, r, eof);
+    if (!conn) {
+        if (errno == EINVAL) fprintf(stderr, "Invalid server IP\n");
+        else fprintf(stderr, "Handshake failed.\n");
+        return 1;
+    }
+    sham_set_nonblock(conn, 1);
+    sham_set_cork(conn, 1);
+
+    int ret = 0;
+    while (!eof && (r = xfer_fill(x, data_buf, sizeof(data_buf))) > 0) {
+        if (xfer_send(conn, x, data_buf, r) < 0) { perror("sham_send"); ret = 1; break; }
+    }
+    if (x->fp) { fclose(x->fp); x->fp = NULL; }
+
+    // Wait until everything is acknowledged so the report covers delivery
+    int sd;
+    while (ret == 0 && (sd = sham_shutdown(conn)) < 0 && errno == EAGAIN) pump(conn, x);
+    if (ret == 0 && sd == 0) {
+        struct sham_stats st;
+        sham_get_stats(conn, &st);
+        double secs = st.elapsed_ms > 0 ? st.elapsed_ms / 1000.0 : 0.001;
+        printf("Sent %llu bytes in %.3f s, goodput %.2f Mbps\n",
+               (unsigned long long)st.bytes_acked, secs, st.bytes_acked * 8.0 / secs / 1e6);
+        // A timeout resends every segment that waited out the RTO, so the
+        // retransmission ratio overstates loss; holes at snd_una count it
+        printf("Retransmitted %llu of %llu segments (%.2f%% retransmission ratio), %llu lost (%.2f%% loss), RTT %.3f ms, pacing %s\n",
+               (unsigned long long)st.segs_retx, (unsigned long long)st.segs_sent,
+               st.segs_sent ? 100.0 * st.segs_retx / st.segs_sent : 0.0, (unsigned long long)st.segs_lost,
+               st.segs_sent ? 100.0 * st.segs_lost / st.segs_sent : 0.0, st.srtt_us / 1000.0,
+               st.pacing_rate ? "on" : "off");
+        if (st.zblocks > 0) {
+            printf("Compressed %llu -> %llu bytes (ratio %.2fx, %llu of %llu blocks bypassed), effective goodput %.2f Mbps\n",
+                   (unsigned long long)st.zraw_bytes, (unsigned long long)st.zenc_bytes,
+                   st.zenc_bytes ? (double)st.zraw_bytes / st.zenc_bytes : 0.0,
+                   (unsigned long long)st.zbypassed, (unsigned long long)st.zblocks,
+                   st.zraw_bytes * 8.0 / secs / 1e6);
+        }
+        if (st.fec_parity > 0) {
+            char now[32] = "now off";
+            if (st.fec_k > 0) snprintf(now, sizeof(now), "now 1 per %u", st.fec_k);
+            printf("FEC: %llu parity segments (%s), server rebuilt %llu lost segments\n",
+                   (unsigned long long)st.fec_parity, now, (unsigned long long)st.fec_peer_rebuilt);
+        }
+    } else if (ret == 0) {
+        perror("sham_shutdown");
+        ret = 1;
+    }
+
+    // Remaining results until the server closes its side
+    sham_set_nonblock(conn, 0);
+    while (ret == 0 && read_results(conn, x) > 0) {}
+    sham_close(conn);
+
+    if (x->batch) printf("Files: %zu sent, %zu verified, %zu failed\n", x->nfiles, x->nok, x->nbad);
+    if (x->nok != x->nfiles) ret = 1;
+    return ret;
+}
 
 int main(int argc, char **argv) {
+    int pacing = SHAM_PACE_USER;
+    bool fastopen = false;
+    bool compress = false;
+    int fec = 0;
+    int busy_poll = 0;
+    int cpu = -1;
+
+    // Pacing options may appear anywhere; the rest keeps its positional meaning
+    int pos = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-pace") == 0) pacing = SHAM_PACE_OFF;
+        else if (strcmp(argv[i], "--kernel-pace") == 0) pacing = SHAM_PACE_KERNEL;
+        else if (strcmp(argv[i], "--fast-open") == 0) fastopen = true;
+        else if (strcmp(argv[i], "--compress") == 0) compress = true;
+        else if (strcmp(argv[i], "--fec") == 0) fec = SHAM_FEC_AUTO;
+        else if (strncmp(argv[i], "--fec=", 6) == 0) fec = atoi(argv[i] + 6);
+        else if (strcmp(argv[i], "--busy-poll") == 0) busy_poll = SHAM_BUSY_POLL_US;
+        else if (strncmp(argv[i], "--busy-poll=", 12) == 0) busy_poll = atoi(argv[i] + 12);
+        else if (strncmp(argv[i], "--cpu=", 6) == 0) cpu = atoi(argv[i] + 6);
+        else argv[pos++] = argv[i];
+    }
+    argc = pos;
+
     if (argc < 4) {
         fprintf(stderr,
-            "Usage:\n File: ./client <server_ip> <server_port> <input_file> <output_file_name> [loss_rate]\n Chat: ./client <server_ip> <server_port> --chat [loss_rate]\n");
+            "Usage:\n File: ./client <server_ip> <server_port> <input_file> <output_file_name> [loss_rate] [--no-pace|--kernel-pace] [--fast-open] [--compress] [--fec[=k]]\n"
+            " Manifest: ./client <server_ip> <server_port> --manifest <list_file> [loss_rate] [options]\n"
+            " Directory: ./client <server_ip> <server_port> --dir <input_dir> <output_dir> [loss_rate] [options]\n"
+            " Chat: ./client <server_ip> <server_port> --chat [loss_rate] [--busy-poll[=us]] [--cpu=N]\n");
         return 1;
     }
 
@@ -95,10 +322,22 @@ int main(int argc, char **argv) {
     const char *input_file = NULL;
     const char *output_file_name = NULL;
     double loss_rate = 0.0;
+    struct xfer x;
+    memset(&x, 0, sizeof(x));
 
-    // --- Step 1: Determine the mode (chat vs. file) ---
+    // --- Step 1: Determine the mode (chat, manifest, directory or single file) ---
     if (strcmp(argv[3], "--chat") == 0) {
         chat_mode = true;
+    } else if (strcmp(argv[3], "--manifest") == 0) {
+        if (argc < 5) { fprintf(stderr, "Error: Missing manifest file.\n"); return 1; }
+        if (add_manifest(&x, argv[4]) < 0) return 1;
+        x.batch = true;
+        if (argc == 6) loss_rate = atof(argv[5]);
+    } else if (strcmp(argv[3], "--dir") == 0) {
+        if (argc < 6) { fprintf(stderr, "Error: Missing input and output directories.\n"); return 1; }
+        add_dir(&x, argv[4], argv[5]);
+        x.batch = true;
+        if (argc == 7) loss_rate = atof(argv[6]);
     } else {
         // File mode requires at least 5 arguments
         if (argc < 5) {
@@ -116,7 +355,7 @@ int main(int argc, char **argv) {
         if (argc == 5) {
             loss_rate = atof(argv[4]);
         }
-    } else {
+    } else if (!x.batch) {
         // For file mode, loss_rate is the 6th argument (index 5)
         // ./client <ip> <port> <in> <out> [loss_rate]
         if (argc == 6) {
@@ -124,323 +363,38 @@ int main(int argc, char **argv) {
         }
     }
 
-    open_log("client_log.txt");
+    sham_log_open("client_log.txt");
 
-    struct sockaddr_in srv;
-    memset(&srv, 0, sizeof(srv));
-    srv.sin_family = AF_INET;
-    srv.sin_port = htons(server_port);
-    if (inet_pton(AF_INET, server_ip, &srv.sin_addr) != 1) {
-        fprintf(stderr, "Invalid server IP\n"); return 1;
-    }
-    socklen_t srv_len = sizeof(srv);
-
-    int sock = create_udp_socket();
-    fcntl(sock, F_SETFL, O_NONBLOCK);
-
-    // ---- three-way handshake ----
-    uint32_t client_isn = (uint32_t)(rand() & 0x7fffffff);
-    struct sham_packet syn; memset(&syn, 0, sizeof(syn));
-    syn.hdr.seq_num = htonl(client_isn);
-    syn.hdr.flags = htons(SHAM_SYN);
-
-    safe_sendto(sock, &syn, sizeof(struct sham_header), 0, (struct sockaddr*)&srv, srv_len);
-    timestamped_log("SND SYN SEQ=%u", client_isn);
-
-    struct sham_packet rcv;
-    uint32_t server_isn = 0;
-    long long start = now_ms();
-    bool handshake_complete = false;
-    while(now_ms() - start < 5000) {
-        ssize_t rc = recvfrom(sock, &rcv, sizeof(rcv), 0, NULL, NULL);
-        if (rc >= (ssize_t)sizeof(struct sham_header)) {
-            uint16_t flags = ntohs(rcv.hdr.flags);
-            if ((flags & (SHAM_SYN | SHAM_ACK))) {
-                server_isn = ntohl(rcv.hdr.seq_num);
-                timestamped_log("RCV SYN-ACK SEQ=%u ACK=%u", server_isn, ntohl(rcv.hdr.ack_num));
-                
-                struct sham_packet ack; memset(&ack, 0, sizeof(ack));
-                ack.hdr.ack_num = htonl(server_isn + 1);
-                ack.hdr.flags = htons(SHAM_ACK);
-                safe_sendto(sock, &ack, sizeof(struct sham_header), 0, (struct sockaddr*)&srv, srv_len);
-                timestamped_log("SND ACK FOR SYN");
-                handshake_complete = true;
-                break;
-            }
-        }
-        sleep_ms(20);
-    }
-    
-    if (!handshake_complete) {
-        fprintf(stderr, "Handshake failed.\n");
-        close_log(); close(sock); return 1;
-    }
-    
-    uint32_t client_seq = client_isn + 1;
+    struct sham_opts opts;
+    sham_opts_init(&opts);
+    opts.loss_rate = loss_rate;
+    opts.pacing = pacing;
+    opts.fastopen = fastopen;
+    opts.fastopen_cache = FASTOPEN_CACHE;
+    opts.compress = compress && !chat_mode;
+    opts.fec = chat_mode ? 0 : fec;
+    opts.busy_poll = busy_poll;
+    if (cpu >= 0 && sham_pin_cpu(cpu) < 0) perror("sched_setaffinity");
 
-    // ---------- CHAT MODE ----------
+    int ret = 0;
     if (chat_mode) {
-        // Chat mode logic as before...
-        printf("Chat mode established. Type messages, /quit to exit.\n");
-        fd_set rfds;
-        char buf[2048];
-        int maxfd = sock > STDIN_FILENO ? sock : STDIN_FILENO;
-        bool shutting_down = false;
-        
-        while (!shutting_down) {
-            // ... (chat logic remains the same as previous correct version)
-            FD_ZERO(&rfds);
-            FD_SET(STDIN_FILENO, &rfds);
-            FD_SET(sock, &rfds);
-            struct timeval tv = {1, 0};
-            int sel = select(maxfd+1, &rfds, NULL, NULL, &tv);
-            if (sel > 0) {
-                 if (FD_ISSET(STDIN_FILENO, &rfds)) {
-                    if (!fgets(buf, sizeof(buf), stdin)) break;
-                    buf[strcspn(buf, "\n")] = 0;
-                    if (strcmp(buf, "/quit") == 0) {
-                        // **** CLIENT-INITIATED TERMINATION ****
-                        struct sham_packet fin; memset(&fin,0,sizeof(fin));
-                        fin.hdr.seq_num = htonl(client_seq);
-                        fin.hdr.flags = htons(SHAM_FIN);
-                        safe_sendto(sock, &fin, sizeof(struct sham_header), 0, (struct sockaddr*)&srv, srv_len);
-                        timestamped_log("SND FIN SEQ=%u", client_seq);
-
-                        bool ack_for_fin_rcvd = false;
-                        bool server_fin_rcvd = false;
-                        long long term_start = now_ms();
-
-                        while(now_ms() - term_start < 5000) {
-                            ssize_t r = recvfrom(sock, &rcv, sizeof(rcv), 0, NULL, NULL);
-                            if (r > 0) {
-                                uint16_t flags = ntohs(rcv.hdr.flags);
-                                if ((flags & SHAM_ACK) && ntohl(rcv.hdr.ack_num) == client_seq + 1) {
-                                    timestamped_log("RCV ACK FOR FIN");
-                                    ack_for_fin_rcvd = true;
-                                }
-                                if (flags & SHAM_FIN) {
-                                    uint32_t server_fin_seq = ntohl(rcv.hdr.seq_num);
-                                    timestamped_log("RCV FIN SEQ=%u", server_fin_seq);
-
-                                    struct sham_packet final_ack; memset(&final_ack, 0, sizeof(final_ack));
-                                    final_ack.hdr.flags = htons(SHAM_ACK);
-                                    final_ack.hdr.ack_num = htonl(server_fin_seq + 1);
-                                    safe_sendto(sock, &final_ack, sizeof(struct sham_header), 0, (struct sockaddr*)&srv, srv_len);
-                                    timestamped_log("SND ACK=%u", ntohl(final_ack.hdr.ack_num));
-                                    server_fin_rcvd = true;
-                                }
-                            }
-                            if (ack_for_fin_rcvd && server_fin_rcvd) break;
-                            sleep_ms(20);
-                        }
-                        shutting_down = true;
-                        continue;
-                    }
-                    struct sham_packet dp; memset(&dp,0,sizeof(dp));
-                    dp.hdr.seq_num = htonl(client_seq);
-                    snprintf(dp.data, sizeof(dp.data), "%s", buf);
-                    size_t ml = strlen(dp.data);
-                    safe_sendto(sock, &dp, sizeof(struct sham_header) + ml, 0, (struct sockaddr*)&srv, srv_len);
-                    timestamped_log("SND DATA SEQ=%u LEN=%zu", client_seq, ml);
-                    client_seq += ml;
-                }
-                if (FD_ISSET(sock, &rfds)) {
-                    ssize_t rc = recvfrom(sock, &rcv, sizeof(rcv), 0, NULL, NULL);
-                    // --- ADD THIS BLOCK TO SIMULATE LOSS ---
-                    if (rc > 0 && loss_rate > 0.0) {
-                        uint16_t flags = ntohs(rcv.hdr.flags);
-                        // Only drop data packets, not control packets
-                        if (!(flags & (SHAM_SYN|SHAM_ACK|SHAM_FIN))) {
-                            if (((double)rand() / RAND_MAX) < loss_rate) {
-                                timestamped_log("DROP DATA SEQ=%u", ntohl(rcv.hdr.seq_num));
-                                continue; // Drop the packet
-                            }
-                        }
-                    }
-                    // --- END OF NEW BLOCK ---
-                    if (rc >= (ssize_t)sizeof(struct sham_header)) {
-                        uint16_t flags = ntohs(rcv.hdr.flags);
-                        if (flags & SHAM_FIN) {
-                             // **** SERVER-INITIATED TERMINATION ****
-                            uint32_t peer_fin_seq = ntohl(rcv.hdr.seq_num);
-                            timestamped_log("RCV FIN SEQ=%u", peer_fin_seq);
-                            
-                            struct sham_packet ack_for_fin; memset(&ack_for_fin,0,sizeof(ack_for_fin));
-                            ack_for_fin.hdr.flags = htons(SHAM_ACK);
-                            ack_for_fin.hdr.ack_num = htonl(peer_fin_seq + 1);
-                            safe_sendto(sock, &ack_for_fin, sizeof(struct sham_header), 0, (struct sockaddr*)&srv, srv_len);
-                            timestamped_log("SND ACK FOR FIN");
-                            
-                            struct sham_packet myfin; memset(&myfin, 0, sizeof(myfin));
-                            myfin.hdr.seq_num = htonl(client_seq);
-                            myfin.hdr.flags = htons(SHAM_FIN);
-                            safe_sendto(sock, &myfin, sizeof(struct sham_header), 0, (struct sockaddr*)&srv, srv_len);
-                            timestamped_log("SND FIN SEQ=%u", client_seq);
-
-                            bool final_ack_rcvd = false;
-                            long long term_start = now_ms();
-                            while(now_ms() - term_start < 5000) {
-                                ssize_t r2 = recvfrom(sock, &rcv, sizeof(rcv), 0, NULL, NULL);
-                                if (r2 >= (ssize_t)sizeof(struct sham_header) && (ntohs(rcv.hdr.flags) & SHAM_ACK) && ntohl(rcv.hdr.ack_num) == client_seq + 1) {
-                                    timestamped_log("RCV ACK=%u", ntohl(rcv.hdr.ack_num));
-                                    final_ack_rcvd = true;
-                                    break;
-                                }
-                                sleep_ms(20);
-                            }
-                            shutting_down = true;
-                        } else {
-                            if (rc > (ssize_t)sizeof(struct sham_header)) {
-                                size_t data_len = rc - sizeof(struct sham_header);
-                                timestamped_log("RCV DATA SEQ=%u LEN=%zu", ntohl(rcv.hdr.seq_num), rc - sizeof(struct sham_header));
-                                printf("Server: %.*s\n", (int)data_len, rcv.data);
-                            }
-                        }
-                    }
-                }
-            }
+        struct sham_conn *conn = sham_connect(server_ip, (uint16_t)server_port, &opts);
+        if (!conn) {
+            if (errno == EINVAL) fprintf(stderr, "Invalid server IP\n");
+            else fprintf(stderr, "Handshake failed.\n");
+            sham_log_close(); return 1;
         }
+        printf("Chat mode established. Type messages, /quit to exit.\n");
+        fflush(stdout);
+        sham_chat(conn, "Server");
     } else {
-        // **** FILE TRANSFER LOGIC STARTS HERE ****
-        uint32_t base_seq = client_isn + 1;
-        uint32_t next_seq = base_seq;
-
-        // Send filename first
-        struct sham_packet namepkt; memset(&namepkt, 0, sizeof(namepkt));
-        namepkt.hdr.seq_num = htonl(base_seq);
-        snprintf(namepkt.data, sizeof(namepkt.data), "%s", output_file_name);
-        size_t nlen = strlen(namepkt.data);
-        safe_sendto(sock, &namepkt, sizeof(struct sham_header) + nlen, 0, (struct sockaddr*)&srv, srv_len);
-        timestamped_log("SND FILENAME %s", namepkt.data);
-        next_seq = base_seq + (uint32_t)nlen;
-
-        // Sliding window implementation
-        FILE *fp = fopen(input_file, "rb");
-        if (!fp) { perror("fopen input"); close_log(); close(sock); return 1; }
-        
-        struct sent_slot slots[MAX_SENT_SLOTS] = {0};
-        uint32_t highest_acked = base_seq - 1;
-
-        bool eof = false;
-        while (!eof || highest_acked < next_seq -1) {
-            int inflight = 0;
-            for(int i=0; i<MAX_SENT_SLOTS; ++i) if(slots[i].in_use) inflight++;
-            
-            while(inflight < SND_WND_PACKETS && !eof) {
-                char data_buf[SHAM_PAYLOAD];
-                size_t r = fread(data_buf, 1, SHAM_PAYLOAD, fp);
-                if (r == 0) { eof = true; break; }
-
-                struct sham_packet dp; memset(&dp, 0, sizeof(dp));
-                dp.hdr.seq_num = htonl(next_seq);
-                memcpy(dp.data, data_buf, r);
-                ssize_t slen = sizeof(struct sham_header) + (ssize_t)r;
-                safe_sendto(sock, &dp, slen, 0, (struct sockaddr*)&srv, srv_len);
-                timestamped_log("SND DATA SEQ=%u LEN=%zu", next_seq, r);
-                
-                int slot = -1;
-                for(int i=0; i<MAX_SENT_SLOTS; ++i) if(!slots[i].in_use) { slot=i; break; }
-                if(slot == -1) { break; /* Should not happen if inflight is correct */ }
-                
-                slots[slot].in_use = 1;
-                memcpy(&slots[slot].pkt, &dp, slen);
-                slots[slot].len = slen;
-                slots[slot].sent_time_ms = now_ms();
-                
-                next_seq += (uint32_t)r;
-                inflight++;
-            }
-            
-            ssize_t rc = recvfrom(sock, &rcv, sizeof(rcv), 0, NULL, NULL);
-            if (rc > 0 && (ntohs(rcv.hdr.flags) & SHAM_ACK)) {
-                uint32_t ackn = ntohl(rcv.hdr.ack_num);
-                timestamped_log("RCV ACK=%u", ackn);
-                if (ackn > highest_acked) {
-                    for (int i = 0; i < MAX_SENT_SLOTS; ++i) if (slots[i].in_use) {
-                        uint32_t pseq = ntohl(slots[i].pkt.hdr.seq_num);
-                        int plen = (int)slots[i].len - (int)sizeof(struct sham_header);
-                        if (pseq + (uint32_t)plen < ackn) slots[i].in_use = 0;
-                    }
-                    highest_acked = ackn - 1;
-                }
-            }
-            
-            long long now = now_ms();
-            for (int i = 0; i < MAX_SENT_SLOTS; ++i) if (slots[i].in_use) {
-                if (now - slots[i].sent_time_ms > RTO_MS) {
-                    uint32_t seq = ntohl(slots[i].pkt.hdr.seq_num);
-                    timestamped_log("TIMEOUT SEQ=%u", seq);
-                    safe_sendto(sock, &slots[i].pkt, slots[i].len, 0, (struct sockaddr*)&srv, srv_len);
-                    slots[i].sent_time_ms = now_ms();
-                    timestamped_log("RETX DATA SEQ=%u LEN=%ld", seq, slots[i].len - (long)sizeof(struct sham_header));
-                }
-            }
-            sleep_ms(10);
-        }
-        fclose(fp);
-
-        // --- File Transfer Termination ---
-        // client.c
-
-        // --- File Transfer Termination ---
-        struct sham_packet finp; memset(&finp,0,sizeof(finp));
-        finp.hdr.seq_num = htonl(next_seq);
-        finp.hdr.flags = htons(SHAM_FIN);
-        safe_sendto(sock, &finp, sizeof(struct sham_header), 0, (struct sockaddr*)&srv, srv_len);
-        timestamped_log("SND FIN SEQ=%u", next_seq);
-
-        long long fin_sent_time = now_ms();
-        bool ack_for_fin_rcvd = false;
-        bool server_fin_rcvd = false;
-        uint32_t server_fin_seq = 0;
-
-        // Single loop to wait for both ACK and FIN
-        while (!ack_for_fin_rcvd || !server_fin_rcvd) {
-            ssize_t rc = recvfrom(sock, &rcv, sizeof(rcv), 0, NULL, NULL);
-            if (rc > 0) {
-                uint16_t flags = ntohs(rcv.hdr.flags);
-                // Check for ACK of our FIN
-                if ((flags & SHAM_ACK) && ntohl(rcv.hdr.ack_num) == next_seq + 1) {
-                    if (!ack_for_fin_rcvd) timestamped_log("RCV ACK FOR FIN");
-                    ack_for_fin_rcvd = true;
-                }
-                // Check for server's FIN
-                if (flags & SHAM_FIN) {
-                    if (!server_fin_rcvd) {
-                         server_fin_seq = ntohl(rcv.hdr.seq_num);
-                         timestamped_log("RCV FIN SEQ=%u", server_fin_seq);
-                         server_fin_rcvd = true;
-                    }
-                }
-            } else {
-                // Timeout logic
-                if (now_ms() - fin_sent_time > RTO_MS && !ack_for_fin_rcvd) {
-                    timestamped_log("TIMEOUT on client FIN, RETX FIN SEQ=%u", next_seq);
-                    safe_sendto(sock, &finp, sizeof(struct sham_header), 0, (struct sockaddr*)&srv, srv_len);
-                    fin_sent_time = now_ms();
-                }
-            }
-            // Break if we are done and have waited a bit
-            if (ack_for_fin_rcvd && server_fin_rcvd) {
-                 break;
-            }
-        }
-
-        // Send the final ACK for the server's FIN
-        if(server_fin_rcvd) {
-            struct sham_packet final_ack; memset(&final_ack, 0, sizeof(final_ack));
-            final_ack.hdr.flags = htons(SHAM_ACK);
-            final_ack.hdr.ack_num = htonl(server_fin_seq + 1);
-            safe_sendto(sock, &final_ack, sizeof(struct sham_header), 0, (struct sockaddr*)&srv, srv_len);
-            timestamped_log("SND FINAL ACK=%u", ntohl(final_ack.hdr.ack_num));
-        }
-
-        sleep_ms(2 * RTO_MS); // Wait briefly to ensure final ACK is sent
-    } // End of file transfer mode
+        if (!x.batch) add_file(&x, input_file, output_file_name);
+        ret = run_file(server_ip, server_port, &opts, &x);
+        if (ret) { sham_log_close(); return ret; }
+    }
 
-    close_log();
-    close(sock);
+    sham_log_close();
     printf("Connection closed.\n");
-    return 0;
+    return ret;
 }
-//#llm generated code ends
\ No newline at end of file
+//#llm generated code ends
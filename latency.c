@@ -0,0 +1,208 @@
+// latency.c
+// #llm generated code begins
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "sham.h"
+
+// Ping-pong latency benchmark: the client sends a message, the server echoes
+// it, and the client records half of each round trip as one-way latency.
+// With --bulk the pings go on stream 1 while stream 0 carries a bulk
+// transfer the whole time, to see what control traffic waits behind it.
+
+#define DEFAULT_COUNT 10000
+#define DEFAULT_SIZE 64
+#define WARMUP 100             // round trips before measuring
+#define BULK_CHUNK (16 * SHAM_PAYLOAD)
+#define PING_STREAM 1
+
+static long long mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples, in microseconds
+static double pct_us(const long long *v, int n, double p) {
+    int i = (int)(p * n + 0.999999) - 1;
+    if (i < 0) i = 0;
+    if (i >= n) i = n - 1;
+    return v[i] / 1000.0;
+}
+
+static int read_full(struct sham_conn *c, char *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = sham_recv(c, buf + got, len - got);
+        if (n <= 0) return -1;
+        got += (size_t)n;
+    }
+    return 0;
+}
+
+static void report(long long *samples, int count, size_t size) {
+    qsort(samples, (size_t)count, sizeof(*samples), cmp_ll);
+    printf("%d messages of %zu bytes, one-way latency (RTT/2) in us:\n", count, size);
+    printf("min %.1f  p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           samples[0] / 1000.0, pct_us(samples, count, 0.50), pct_us(samples, count, 0.99),
+           pct_us(samples, count, 0.999), samples[count - 1] / 1000.0);
+}
+
+// Discard stream 0, echo the ping stream
+static int bulk_server(struct sham_conn *c) {
+    char buf[BULK_CHUNK];
+    sham_set_nonblock(c, 1);
+    sham_set_priority(c, PING_STREAM, 1, 1);
+    for (;;) {
+        ssize_t n;
+        while ((n = sham_recv(c, buf, sizeof(buf))) > 0) {}
+        if (n == 0) break;
+        if (errno != EAGAIN) { perror("sham_recv"); break; }
+        while ((n = sham_recv_stream(c, PING_STREAM, buf, sizeof(buf))) > 0) {
+            if (sham_send_stream(c, PING_STREAM, buf, (size_t)n) < n) { perror("sham_send_stream"); break; }
+        }
+        if (sham_wait(c, NULL, 0, -1) < 0) break;
+    }
+    sham_set_nonblock(c, 0);
+    sham_close(c);
+    return 0;
+}
+
+static int run_server(struct sham_conn *c) {
+    char buf[16 * SHAM_PAYLOAD];
+    ssize_t n;
+    while ((n = sham_recv(c, buf, sizeof(buf))) > 0) {
+        if (sham_send(c, buf, (size_t)n) < 0) { perror("sham_send"); break; }
+    }
+    sham_close(c);
+    return 0;
+}
+
+static int run_client(struct sham_conn *c, int count, size_t size) {
+    // Allocated once; the loop itself does no allocation or clearing
+    char *msg = malloc(size), *echo = malloc(size);
+    long long *samples = malloc((size_t)count * sizeof(*samples));
+    if (!msg || !echo || !samples) { perror("malloc"); return 1; }
+    memset(msg, 'x', size);
+
+    for (int i = 0; i < WARMUP + count; ++i) {
+        long long t0 = mono_ns();
+        if (sham_send(c, msg, size) < 0 || read_full(c, echo, size) < 0) {
+            fprintf(stderr, "Connection lost after %d messages\n", i);
+            sham_close(c);
+            return 1;
+        }
+        if (i >= WARMUP) samples[i - WARMUP] = (mono_ns() - t0) / 2;
+    }
+    sham_close(c);
+
+    report(samples, count, size);
+    free(msg); free(echo); free(samples);
+    return 0;
+}
+
+// Pings on their own stream while stream 0 is kept backlogged with bulk data.
+// prio = 1 gives the pings priority; 0 leaves them in round robin with the bulk.
+static int bulk_client(struct sham_conn *c, int count, size_t size, int prio) {
+    static char bulk[BULK_CHUNK];
+    char *msg = malloc(size), *echo = malloc(size);
+    long long *samples = malloc((size_t)count * sizeof(*samples));
+    if (!msg || !echo || !samples) { perror("malloc"); return 1; }
+    memset(msg, 'x', size);
+    sham_set_nonblock(c, 1);
+    if (prio) sham_set_priority(c, PING_STREAM, 1, 1);
+
+    uint64_t bulk_bytes = 0;
+    long long start = mono_ns();
+    for (int i = 0; i < WARMUP + count; ++i) {
+        long long t0 = mono_ns();
+        size_t sent = 0, got = 0;
+        while (got < size) {
+            ssize_t n = sham_send(c, bulk, sizeof(bulk));
+            if (n > 0) bulk_bytes += (uint64_t)n;
+            if (sent < size && (n = sham_send_stream(c, PING_STREAM, msg + sent, size - sent)) > 0)
+                sent += (size_t)n;
+            n = sham_recv_stream(c, PING_STREAM, echo + got, size - got);
+            if (n > 0) { got += (size_t)n; continue; }
+            if ((n < 0 && errno != EAGAIN) || n == 0 || sham_wait(c, NULL, 0, -1) < 0) {
+                fprintf(stderr, "Connection lost after %d messages\n", i);
+                sham_set_nonblock(c, 0);
+                sham_close(c);
+                return 1;
+            }
+        }
+        if (i >= WARMUP) samples[i - WARMUP] = (mono_ns() - t0) / 2;
+    }
+    double secs = (mono_ns() - start) / 1e9;
+    sham_set_nonblock(c, 0);
+    sham_close(c);
+
+    report(samples, count, size);
+    printf("bulk on stream 0: %.1f Mbps, pings %s\n", bulk_bytes * 8 / secs / 1e6,
+           prio ? "prioritized" : "in round robin");
+    free(msg); free(echo); free(samples);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int busy_poll = 0;
+    int cpu = -1;
+    int bulk = 0;              // 1 = bulk with prioritized pings, 2 = bulk, equal priority
+
+    // Options may appear anywhere; the rest is positional
+    int pos = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--busy-poll") == 0) busy_poll = SHAM_BUSY_POLL_US;
+        else if (strncmp(argv[i], "--busy-poll=", 12) == 0) busy_poll = atoi(argv[i] + 12);
+        else if (strncmp(argv[i], "--cpu=", 6) == 0) cpu = atoi(argv[i] + 6);
+        else if (strcmp(argv[i], "--bulk") == 0) bulk = 1;
+        else if (strcmp(argv[i], "--bulk=fair") == 0) bulk = 2;
+        else argv[pos++] = argv[i];
+    }
+    argc = pos;
+
+    int server = argc == 3 && strcmp(argv[1], "server") == 0;
+    if (!server && !(argc >= 4 && argc <= 6 && strcmp(argv[1], "client") == 0)) {
+        fprintf(stderr,
+            "Usage:\n Server: ./latency server <port> [--busy-poll[=us]] [--cpu=N] [--bulk]\n"
+            " Client: ./latency client <server_ip> <server_port> [count] [size] [--busy-poll[=us]] [--cpu=N]\n"
+            "         [--bulk[=fair]]\n");
+        return 1;
+    }
+    if (cpu >= 0 && sham_pin_cpu(cpu) < 0) perror("sched_setaffinity");
+
+    struct sham_opts opts;
+    sham_opts_init(&opts);
+    opts.busy_poll = busy_poll;
+    opts.streams = bulk != 0;
+
+    if (server) {
+        struct sham_conn *c = sham_listen((uint16_t)atoi(argv[2]), &opts);
+        if (!c) { perror("sham_listen"); return 1; }
+        return bulk ? bulk_server(c) : run_server(c);
+    }
+
+    int count = argc > 4 ? atoi(argv[4]) : DEFAULT_COUNT;
+    int size = argc > 5 ? atoi(argv[5]) : DEFAULT_SIZE;
+    if (count <= 0 || size <= 0) { fprintf(stderr, "count and size must be positive\n"); return 1; }
+    struct sham_conn *c = sham_connect(argv[2], (uint16_t)atoi(argv[3]), &opts);
+    if (!c) {
+        if (errno == EINVAL) fprintf(stderr, "Invalid server IP\n");
+        else fprintf(stderr, "Handshake failed.\n");
+        return 1;
+    }
+    if (bulk) return bulk_client(c, count, (size_t)size, bulk == 1);
+    return run_client(c, count, (size_t)size);
+}
+//#llm generated code ends
@@ -1,6 +1,7 @@
 // server.c
 //#llm generated codes begins
 #define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64     // files over 2 GB on 32-bit builds too
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,73 +10,136 @@
 #include <errno.h>
 #include <time.h>
 #include <sys/time.h>
-#include <sys/socket.h>
-#include <arpa/inet.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <fcntl.h>
 #include <openssl/md5.h>
-#include <stdarg.h>
 #include <sys/select.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
 
 #include "sham.h"
+#include "sham_chat.h"
+#include "sham_file.h"
 
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 
-#define RTO_MS 500
-#define RECV_BUF_SLOTS 1024
-
-static FILE *log_file = NULL;
-static int logging_enabled = 0;
+#define FASTOPEN_KEY ".sham_fastopen_key"
 
-static void open_log(const char *name) {
-    char *env = getenv("RUDP_LOG");
-    if (env && strcmp(env, "1") == 0) {
-        logging_enabled = 1;
-        log_file = fopen(name, "w");
+// Read exactly len bytes; returns len, 0 on a clean EOF before any byte, -1 otherwise
+static ssize_t read_full(struct sham_conn *conn, void *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = sham_recv(conn, (char *)buf + got, len - got);
+        if (n <= 0) return got == 0 && n == 0 ? 0 : -1;
+        got += (size_t)n;
     }
-}
-static void close_logfile(void) {
-    if (log_file) fclose(log_file);
-    log_file = NULL;
-    logging_enabled = 0;
+    return (ssize_t)len;
 }
 
-static void timestamped_log(const char *fmt, ...) {
-    if (!logging_enabled || !log_file) return;
-    struct timeval tv; gettimeofday(&tv, NULL);
-    time_t cur = tv.tv_sec;
-    struct tm *tm = localtime(&cur);
-    char timebuf[64];
-    strftime(timebuf, sizeof(timebuf), "%Y-%m-%d %H:%M:%S", tm);
-    fprintf(log_file, "[%s.%06ld] [LOG] ", timebuf, (long)tv.tv_usec);
-    va_list ap; va_start(ap, fmt); vfprintf(log_file, fmt, ap); va_end(ap);
-    fprintf(log_file, "\n"); fflush(log_file);
+// Batch names must stay below the server's working directory
+static bool safe_name(const char *name) {
+    if (name[0] == '/') return false;
+    for (const char *p = name; *p; ) {
+        size_t l = strcspn(p, "/");
+        if (l == 0 || (l == 1 && p[0] == '.') || (l == 2 && p[0] == '.' && p[1] == '.')) return false;
+        p += l;
+        if (*p == '/') p++;
+    }
+    return true;
 }
 
-static void sleep_ms(int ms) {
-    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
-    nanosleep(&ts, NULL);
-}
-static long long now_ms(void) {
-    struct timeval tv; gettimeofday(&tv, NULL);
-    return (long long)tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+// mkdir -p for every parent directory of path
+static void make_parents(const char *path) {
+    char tmp[SHAM_FILE_NAME_MAX + 1];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = strchr(tmp, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        if (mkdir(tmp, 0755) < 0 && errno != EEXIST) break;
+        *p = '/';
+    }
 }
-static int create_udp_socket(void) {
-    int s = socket(AF_INET, SOCK_DGRAM, 0);
-    if (s < 0) { perror("socket"); exit(1); }
-    return s;
+
+// Receive one file record; false at end of stream or on a framing error
+static bool recv_file(struct sham_conn *conn, char *buf, size_t bufsz, int *nfiles, int *nfailed) {
+    struct sham_file_hdr hdr;
+    char name[SHAM_FILE_NAME_MAX + 1];
+
+    ssize_t r = read_full(conn, &hdr, sizeof(hdr));
+    if (r == 0) return false;
+    if (r < 0 || ntohl(hdr.magic) != SHAM_FILE_MAGIC) {
+        fprintf(stderr, "Invalid file header received\n");
+        return false;
+    }
+    size_t nlen = ntohs(hdr.name_len);
+    uint16_t flags = ntohs(hdr.flags);
+    uint64_t left = ((uint64_t)ntohl(hdr.size_hi) << 32) | ntohl(hdr.size_lo);
+    if (nlen == 0 || nlen > SHAM_FILE_NAME_MAX || read_full(conn, name, nlen) <= 0) {
+        fprintf(stderr, "Invalid filename received\n");
+        return false;
+    }
+    name[nlen] = '\0';
+    sham_log("RCV FILENAME %s", name);
+
+    bool batch = flags & SHAM_FILE_BATCH;
+    FILE *out = NULL;
+    if (batch && !safe_name(name)) {
+        fprintf(stderr, "Rejected unsafe name %s\n", name);
+    } else {
+        if (batch) make_parents(name);
+        out = fopen(name, "wb");
+        if (!out) perror(name);
+    }
+    MD5_CTX md5ctx;
+    MD5_Init(&md5ctx);
+
+    // Data is drained even when the file cannot be written so the next record lines up
+    bool ok = out != NULL;
+    while (left > 0) {
+        size_t want = left < bufsz ? (size_t)left : bufsz;
+        ssize_t n = sham_recv(conn, buf, want);
+        if (n <= 0) { fprintf(stderr, "Connection closed inside %s\n", name); ok = false; break; }
+        if (out && fwrite(buf, 1, (size_t)n, out) != (size_t)n) ok = false;
+        MD5_Update(&md5ctx, buf, (size_t)n);
+        left -= (uint64_t)n;
+    }
+    if (out && fclose(out) != 0) ok = false;
+
+    unsigned char md5sum[MD5_DIGEST_LENGTH];
+    char hex[2 * MD5_DIGEST_LENGTH + 1];
+    MD5_Final(md5sum, &md5ctx);
+    for (int i = 0; i < MD5_DIGEST_LENGTH; ++i) sprintf(hex + 2 * i, "%02x", md5sum[i]);
+    if (batch) printf("MD5: %s  %s\n", ok ? hex : "-", name);
+    else printf("MD5: %s\n", hex);
+
+    // Per-file result back to the client
+    char line[SHAM_FILE_NAME_MAX + 64];
+    int ll = snprintf(line, sizeof(line), "%s %s %s\n", ok ? "OK" : "ERR", ok ? hex : "-", name);
+    sham_send(conn, line, (size_t)ll);
+    (*nfiles)++;
+    if (!ok) (*nfailed)++;
+    return left == 0;
 }
-static ssize_t safe_sendto(int sock, const void *buf, size_t len, int flags,
-                           const struct sockaddr *dest_addr, socklen_t addrlen) {
-    ssize_t r = sendto(sock, buf, len, flags, dest_addr, addrlen);
-    if (r < 0) perror("sendto");
-    return r;
+
+static void run_file(struct sham_conn *conn) {
+    char buf[16 * SHAM_PAYLOAD];
+    int nfiles = 0, nfailed = 0;
+
+    // All files share the connection: one record each until the client's FIN
+    while (recv_file(conn, buf, sizeof(buf), &nfiles, &nfailed)) {}
+
+    struct sham_stats st;
+    sham_get_stats(conn, &st);
+    if (st.fec_rebuilt > 0) printf("FEC rebuilt %llu lost segments\n", (unsigned long long)st.fec_rebuilt);
+
+    sham_close(conn);   // four-way handshake (server side)
+    if (nfiles > 1 || nfailed > 0)
+        printf("Received %d files, %d failed\n", nfiles, nfailed);
 }
 
 int main(int argc, char **argv) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: ./server <port> [--chat] [loss_rate]\n");
+        fprintf(stderr, "Usage: ./server <port> [--chat] [loss_rate] [--busy-poll[=us]] [--cpu=N]\n");
         return 1;
     }
 
@@ -84,300 +148,61 @@ int main(int argc, char **argv) {
     int port = atoi(argv[1]);
     bool chat_mode = false;
     double loss_rate = 0.0;
+    int busy_poll = 0;
+    int cpu = -1;
 
     for (int i = 2; i < argc; i++) {
         if (strcmp(argv[i], "--chat") == 0) {
             chat_mode = true;
+        } else if (strcmp(argv[i], "--busy-poll") == 0) {
+            busy_poll = SHAM_BUSY_POLL_US;
+        } else if (strncmp(argv[i], "--busy-poll=", 12) == 0) {
+            busy_poll = atoi(argv[i] + 12);
+        } else if (strncmp(argv[i], "--cpu=", 6) == 0) {
+            cpu = atoi(argv[i] + 6);
         } else {
             loss_rate = atof(argv[i]);
         }
     }
 
-    open_log("server_log.txt");
+    sham_log_open("server_log.txt");
 
-    int sock = create_udp_socket();
-    struct sockaddr_in me; memset(&me, 0, sizeof(me));
-    me.sin_family = AF_INET; me.sin_addr.s_addr = INADDR_ANY; me.sin_port = htons(port);
-    if (bind(sock, (struct sockaddr*)&me, sizeof(me)) < 0) { perror("bind"); close_logfile(); close(sock); return 1; }
-    fcntl(sock, F_SETFL, O_NONBLOCK);
+    struct sham_opts opts;
+    sham_opts_init(&opts);
+    opts.loss_rate = loss_rate;
+    opts.nonblock = 1;
+    opts.fastopen_key = FASTOPEN_KEY;
+    opts.busy_poll = busy_poll;
+    if (cpu >= 0 && sham_pin_cpu(cpu) < 0) perror("sched_setaffinity");
 
+    struct sham_conn *conn = sham_listen((uint16_t)port, &opts);
+    if (!conn) { perror("bind"); sham_log_close(); return 1; }
     printf("Server listening on port %d...\n", port);
-
-    struct sockaddr_in cli; socklen_t cli_len = sizeof(cli);
-    struct sham_packet rcv;
+    fflush(stdout);
 
     // --------- Three-way handshake ----------
-    ssize_t rc;
-    uint32_t client_isn = 0, server_isn = 0;
-    while (1) {
-        rc = recvfrom(sock, &rcv, sizeof(rcv), 0, (struct sockaddr*)&cli, &cli_len);
-        if (rc >= (ssize_t)sizeof(struct sham_header)) {
-            if (ntohs(rcv.hdr.flags) & SHAM_SYN) {
-                client_isn = ntohl(rcv.hdr.seq_num);
-                timestamped_log("RCV SYN SEQ=%u", client_isn);
-
-                server_isn = (uint32_t)(rand() & 0x7fffffff);
-                struct sham_packet synack; memset(&synack, 0, sizeof(synack));
-                synack.hdr.seq_num = htonl(server_isn);
-                synack.hdr.ack_num = htonl(client_isn + 1);
-                synack.hdr.flags = htons(SHAM_SYN | SHAM_ACK);
-                safe_sendto(sock, &synack, sizeof(struct sham_header), 0, (struct sockaddr*)&cli, cli_len);
-                timestamped_log("SND SYN-ACK SEQ=%u ACK=%u", server_isn, client_isn + 1);
-
-                long long start = now_ms();
-                bool handshake_complete = false;
-                while (now_ms() - start < 5000) {
-                    ssize_t r = recvfrom(sock, &rcv, sizeof(rcv), 0, (struct sockaddr*)&cli, &cli_len);
-                    if (r >= (ssize_t)sizeof(struct sham_header) && (ntohs(rcv.hdr.flags) & SHAM_ACK) && ntohl(rcv.hdr.ack_num) == server_isn + 1) {
-                        timestamped_log("RCV ACK FOR SYN");
-                        handshake_complete = true;
-                        break;
-                    }
-                    sleep_ms(20);
-                }
-                if (handshake_complete) break;
-            }
-        } else sleep_ms(50);
+    while (sham_state(conn) != SHAM_ESTABLISHED) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(sham_fd(conn), &rfds);
+        int t = sham_timeout_ms(conn);
+        struct timeval tv = { t >= 0 ? t / 1000 : 1, t >= 0 ? (t % 1000) * 1000 : 0 };
+        select(sham_fd(conn) + 1, &rfds, NULL, NULL, &tv);
+        sham_process(conn);
     }
-    
-    uint32_t server_seq = server_isn + 1;
-    
+    sham_set_nonblock(conn, 0);
+
     // ----------- Main Logic: Chat or File Transfer -----------
     if (chat_mode) {
-        // Chat mode logic as before...
         printf("Chat mode server established. Type messages, /quit to exit.\n");
-        fd_set rfds;
-        char buf[2048];
-        int maxfd = sock > STDIN_FILENO ? sock : STDIN_FILENO;
-
-        while (1) {
-            FD_ZERO(&rfds);
-            FD_SET(STDIN_FILENO, &rfds);
-            FD_SET(sock, &rfds);
-            struct timeval tv = {1, 0};
-            int sel = select(maxfd+1, &rfds, NULL, NULL, &tv);
-            if (sel > 0) {
-                 if (FD_ISSET(STDIN_FILENO, &rfds)) {
-                    if (!fgets(buf, sizeof(buf), stdin)) break;
-                    buf[strcspn(buf, "\n")] = 0;
-                    if (strcmp(buf, "/quit") == 0) {
-                        // **** SERVER-INITIATED TERMINATION ****
-                        struct sham_packet fin; memset(&fin, 0, sizeof(fin));
-                        fin.hdr.seq_num = htonl(server_seq);
-                        fin.hdr.flags = htons(SHAM_FIN);
-                        safe_sendto(sock, &fin, sizeof(struct sham_header), 0, (struct sockaddr*)&cli, cli_len);
-                        timestamped_log("SND FIN SEQ=%u", server_seq);
-
-                        bool ack_for_fin_rcvd = false;
-                        bool client_fin_rcvd = false;
-                        long long start = now_ms();
-
-                        while(now_ms() - start < 5000) {
-                            ssize_t r = recvfrom(sock, &rcv, sizeof(rcv), 0, (struct sockaddr*)&cli, &cli_len);
-                            if (r > 0) {
-                                uint16_t flags = ntohs(rcv.hdr.flags);
-                                if ((flags & SHAM_ACK) && ntohl(rcv.hdr.ack_num) == server_seq + 1) {
-                                    timestamped_log("RCV ACK FOR FIN");
-                                    ack_for_fin_rcvd = true;
-                                }
-                                if (flags & SHAM_FIN) {
-                                    uint32_t client_fin_seq = ntohl(rcv.hdr.seq_num);
-                                    timestamped_log("RCV FIN SEQ=%u", client_fin_seq);
-                                    
-                                    struct sham_packet final_ack; memset(&final_ack, 0, sizeof(final_ack));
-                                    final_ack.hdr.flags = htons(SHAM_ACK);
-                                    final_ack.hdr.ack_num = htonl(client_fin_seq + 1);
-                                    safe_sendto(sock, &final_ack, sizeof(struct sham_header), 0, (struct sockaddr*)&cli, cli_len);
-                                    timestamped_log("SND ACK=%u", ntohl(final_ack.hdr.ack_num));
-                                    client_fin_rcvd = true;
-                                }
-                            }
-                            if (ack_for_fin_rcvd && client_fin_rcvd) break;
-                            sleep_ms(20);
-                        }
-                        goto cleanup_and_exit;
-                    }
-                    struct sham_packet dp; memset(&dp,0,sizeof(dp));
-                    dp.hdr.seq_num = htonl(server_seq);
-                    snprintf(dp.data, sizeof(dp.data), "%s", buf);
-                    size_t ml = strlen(dp.data);
-                    safe_sendto(sock, &dp, sizeof(struct sham_header) + ml, 0, (struct sockaddr*)&cli, cli_len);
-                    timestamped_log("SND DATA SEQ=%u LEN=%zu", server_seq, ml);
-                    server_seq += ml;
-                }
-                if (FD_ISSET(sock, &rfds)) {
-                    ssize_t r = recvfrom(sock, &rcv, sizeof(rcv), 0, NULL, NULL);
-                    //for loss in chat
-                    if (r > 0 && loss_rate > 0.0) {
-                        uint16_t flags = ntohs(rcv.hdr.flags);
-                        // Only drop data packets
-                        if (!(flags & (SHAM_SYN|SHAM_ACK|SHAM_FIN))) {
-                            if (((double)rand() / RAND_MAX) < loss_rate) {
-                                timestamped_log("DROP DATA SEQ=%u", ntohl(rcv.hdr.seq_num));
-                                continue; // Drop the packet
-                            }
-                        }
-                    }
-                    //loss block end
-                    if (r >= (ssize_t)sizeof(struct sham_header)) {
-                        uint16_t flags = ntohs(rcv.hdr.flags);
-                        if (flags & SHAM_FIN) {
-                             // **** CLIENT-INITIATED TERMINATION ****
-                            uint32_t peer_fin_seq = ntohl(rcv.hdr.seq_num);
-                            timestamped_log("RCV FIN SEQ=%u", peer_fin_seq);
-                            
-                            struct sham_packet ack_for_fin; memset(&ack_for_fin,0,sizeof(ack_for_fin));
-                            ack_for_fin.hdr.flags = htons(SHAM_ACK);
-                            ack_for_fin.hdr.ack_num = htonl(peer_fin_seq + 1);
-                            safe_sendto(sock, &ack_for_fin, sizeof(struct sham_header), 0, (struct sockaddr*)&cli, cli_len);
-                            timestamped_log("SND ACK FOR FIN");
-
-                            struct sham_packet server_fin; memset(&server_fin,0,sizeof(server_fin));
-                            server_fin.hdr.seq_num = htonl(server_seq);
-                            server_fin.hdr.flags = htons(SHAM_FIN);
-                            safe_sendto(sock, &server_fin, sizeof(struct sham_header), 0, (struct sockaddr*)&cli, cli_len);
-                            timestamped_log("SND FIN SEQ=%u", server_seq);
-
-                            bool final_ack_rcvd = false;
-                            long long start = now_ms();
-                            while(now_ms() - start < 5000) {
-                                ssize_t r2 = recvfrom(sock, &rcv, sizeof(rcv), 0, NULL, NULL);
-                                if (r2 >= (ssize_t)sizeof(struct sham_header) && (ntohs(rcv.hdr.flags) & SHAM_ACK) && ntohl(rcv.hdr.ack_num) == server_seq + 1) {
-                                    timestamped_log("RCV ACK=%u", ntohl(rcv.hdr.ack_num));
-                                    final_ack_rcvd = true;
-                                    break;
-                                }
-                                sleep_ms(20);
-                            }
-                            goto cleanup_and_exit;
-                        } else {
-                            if (r > (ssize_t)sizeof(struct sham_header)) {
-                                timestamped_log("RCV DATA SEQ=%u LEN=%zu", ntohl(rcv.hdr.seq_num), r - sizeof(struct sham_header));
-                                size_t len = r - sizeof(struct sham_header);
-                                printf("Client: %.*s\n", (int)len, rcv.data);
-                            }
-                        }
-                    }
-                }
-            }
-        }
+        fflush(stdout);
+        sham_chat(conn, "Client");
     } else {
-        // **** FILE TRANSFER LOGIC STARTS HERE ****
-        rc = -1;
-        long long fname_start = now_ms();
-        while (rc <= 0) {
-            rc = recvfrom(sock, &rcv, sizeof(rcv), 0, (struct sockaddr*)&cli, &cli_len);
-            if (rc > 0) break;
-            if (now_ms() - fname_start > 20000) { fprintf(stderr,"Timeout waiting for filename\n"); goto cleanup_and_exit; }
-            sleep_ms(50);
-        }
-
-        size_t fnlen = (rc > (ssize_t)sizeof(struct sham_header)) ? (size_t)rc - sizeof(struct sham_header) : 0;
-        if (fnlen == 0 || fnlen >= 1024) { fprintf(stderr, "Invalid filename received\n"); goto cleanup_and_exit; }
-        
-        char output_filename[1024];
-        memcpy(output_filename, rcv.data, fnlen);
-        output_filename[fnlen] = '\0';
-        timestamped_log("RCV FILENAME %s", output_filename);
-
-        uint32_t expected_seq = ntohl(rcv.hdr.seq_num) + (uint32_t)fnlen;
-
-        FILE *out = fopen(output_filename, "wb");
-        if (!out) { perror("fopen"); goto cleanup_and_exit; }
-        MD5_CTX md5ctx;
-        MD5_Init(&md5ctx);
-
-        struct sham_packet ackpkt; memset(&ackpkt,0,sizeof(ackpkt));
-        ackpkt.hdr.flags = htons(SHAM_ACK);
-        ackpkt.hdr.ack_num = htonl(expected_seq);
-        safe_sendto(sock, &ackpkt, sizeof(struct sham_header), 0, (struct sockaddr*)&cli, cli_len);
-        timestamped_log("SND ACK=%u WIN=65535", expected_seq);
-
-        bool got_fin_from_client = false;
-
-        while (!got_fin_from_client) {
-            rc = recvfrom(sock, &rcv, sizeof(rcv), 0, (struct sockaddr*)&cli, &cli_len);
-            if (rc > 0) {
-                uint16_t flags = ntohs(rcv.hdr.flags);
-                if (loss_rate > 0.0 && !(flags & (SHAM_SYN|SHAM_ACK|SHAM_FIN))) {
-                    if (((double)rand() / RAND_MAX) < loss_rate) { 
-                        timestamped_log("DROP DATA SEQ=%u", ntohl(rcv.hdr.seq_num)); 
-                        continue; 
-                    }
-                }
-
-                if (flags & SHAM_FIN) {
-                    uint32_t client_fin_seq = ntohl(rcv.hdr.seq_num);
-                    timestamped_log("RCV FIN SEQ=%u", client_fin_seq);
-                    ackpkt.hdr.ack_num = htonl(client_fin_seq + 1);
-                    safe_sendto(sock, &ackpkt, sizeof(struct sham_header), 0, (struct sockaddr*)&cli, cli_len);
-                    timestamped_log("SND ACK FOR FIN");
-                    got_fin_from_client = true;
-                    continue; // Continue to 4-way handshake
-                }
-
-                uint32_t seq = ntohl(rcv.hdr.seq_num);
-                size_t data_len = (size_t)rc - sizeof(struct sham_header);
-                timestamped_log("RCV DATA SEQ=%u LEN=%zu", seq, data_len);
-
-                if (seq == expected_seq) {
-                    if (data_len > 0) {
-                        fwrite(rcv.data, 1, data_len, out);
-                        MD5_Update(&md5ctx, rcv.data, data_len);
-                    }
-                    expected_seq += (uint32_t)data_len;
-                }
-                
-                ackpkt.hdr.ack_num = htonl(expected_seq);
-                safe_sendto(sock, &ackpkt, sizeof(struct sham_header), 0, (struct sockaddr*)&cli, cli_len);
-                timestamped_log("SND ACK=%u WIN=65535", expected_seq);
-
-            } else {
-                sleep_ms(10);
-            }
-        }
-
-        // --- Four-way handshake (server side) ---
-        struct sham_packet server_fin; memset(&server_fin,0,sizeof(server_fin));
-        server_fin.hdr.seq_num = htonl(server_seq);
-        server_fin.hdr.flags = htons(SHAM_FIN);
-        safe_sendto(sock, &server_fin, sizeof(struct sham_header), 0, (struct sockaddr*)&cli, cli_len);
-        timestamped_log("SND FIN SEQ=%u", server_seq);
-        
-        long long fin_sent_time = now_ms();
-        bool final_ack_rcvd = false;
-        
-        while(!final_ack_rcvd) {
-             rc = recvfrom(sock, &rcv, sizeof(rcv), 0, NULL, NULL);
-             if (rc > 0 && (ntohs(rcv.hdr.flags) & SHAM_ACK) && (ntohl(rcv.hdr.ack_num) == server_seq + 1)) {
-                 timestamped_log("RCV FINAL ACK=%u", ntohl(rcv.hdr.ack_num));
-                 final_ack_rcvd = true;
-             } else {
-                 // Timeout logic
-                 if (now_ms() - fin_sent_time > RTO_MS) {
-                     timestamped_log("TIMEOUT on server FIN, RETX FIN SEQ=%u", server_seq);
-                     safe_sendto(sock, &server_fin, sizeof(struct sham_header), 0, (struct sockaddr*)&cli, cli_len);
-                     fin_sent_time = now_ms();
-                 }
-             }
-             if (now_ms() - fin_sent_time > 4000) { // Safety break
-                 timestamped_log("TIMEOUT waiting for final ACK, closing.");
-                 break;
-             }
-        }
-
-        fclose(out);
-        unsigned char md5sum[MD5_DIGEST_LENGTH];
-        MD5_Final(md5sum, &md5ctx);
-        printf("MD5: ");
-        for (int i = 0; i < MD5_DIGEST_LENGTH; ++i) printf("%02x", md5sum[i]);
-        printf("\n");
-    } // End of file transfer mode
+        run_file(conn);
+    }
 
-cleanup_and_exit:
-    close_logfile();
-    close(sock);
+    sham_log_close();
     printf("Connection closed.\n");
     return 0;
 }
-//#llm generated code ends
\ No newline at end of file
+//#llm generated code ends
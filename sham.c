@@ -0,0 +1,1632 @@
+// sham.c
+// #llm generated code begins
+#define _GNU_SOURCE            // sched_setaffinity
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <poll.h>
+#include <sched.h>
+#include <openssl/md5.h>
+
+#include "sham.h"
+#include "sham_compress.h"
+#include "sham_fec.h"
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+#define RTO_MS 500
+#define SND_WND_PACKETS 10
+#define MAX_SENT_SLOTS 128
+#define SND_BUF_BYTES (64 * 1024)
+#define RCV_BUF_BYTES 65535
+#define HANDSHAKE_TIMEOUT_MS 5000
+#define CLOSE_TIMEOUT_MS 5000
+#define PACING_GAIN 1.25       // pace slightly above window/RTT so pacing never caps throughput
+#define RX_SEGS 64             // received segments kept for reordering and FEC rebuilds
+#define RX_PARITY 8            // parity segments waiting for a rebuild
+#define FEC_MAX_K SND_WND_PACKETS  // a block must fit in the window or its parity waits for an RTO
+#define FEC_EPOCH 64           // segments between loss estimates (adaptive FEC)
+#define FEC_INIT_LOSS 0.05     // adaptive FEC starts out assuming 5% loss
+#define SPIN_BACKOFF_MAX 64    // pause instructions between busy-poll checks, at most
+#define CTRL_EXTRA_PACKETS 2   // segments priority streams may send beyond the window
+#define DRR_QUANTUM SHAM_PAYLOAD   // bytes per unit of weight per round-robin turn
+#define STREAM_HDR sizeof(struct sham_stream_hdr)
+
+// Sequence numbers wrap at 2^32, so they are compared with serial-number
+// arithmetic (RFC 1982): valid while the values are within 2^31 of each other
+#define SEQ_LT(a, b)  ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+#define SEQ_LEQ(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)) <= 0)
+#define SEQ_GT(a, b)  SEQ_LT(b, a)
+#define SEQ_GEQ(a, b) SEQ_LEQ(b, a)
+
+// ---------------- logging ----------------
+
+static FILE *log_file = NULL;
+static int logging_enabled = 0;
+
+void sham_log_open(const char *name) {
+    char *env = getenv("RUDP_LOG");
+    if (env && strcmp(env, "1") == 0) {
+        logging_enabled = 1;
+        log_file = fopen(name, "w");
+    }
+}
+void sham_log_close(void) {
+    if (log_file) fclose(log_file);
+    log_file = NULL;
+    logging_enabled = 0;
+}
+void sham_log(const char *fmt, ...) {
+    if (!logging_enabled || !log_file) return;
+    struct timeval tv; gettimeofday(&tv, NULL);
+    time_t cur = tv.tv_sec;
+    struct tm *tm = localtime(&cur);
+    char timebuf[64];
+    strftime(timebuf, sizeof(timebuf), "%Y-%m-%d %H:%M:%S", tm);
+    fprintf(log_file, "[%s.%06ld] [LOG] ", timebuf, (long)tv.tv_usec);
+    va_list ap; va_start(ap, fmt); vfprintf(log_file, fmt, ap); va_end(ap);
+    fprintf(log_file, "\n"); fflush(log_file);
+}
+
+static long long now_ms(void) {
+    struct timeval tv; gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+}
+static long long now_us(void) {
+    struct timeval tv; gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// ---------------- byte ring (send queue / receive queue) ----------------
+
+struct sham_ring {
+    char *buf;
+    size_t cap, head, len;
+};
+
+static int ring_init(struct sham_ring *r, size_t cap) {
+    r->buf = malloc(cap);
+    r->cap = cap; r->head = 0; r->len = 0;
+    return r->buf ? 0 : -1;
+}
+static size_t ring_free(const struct sham_ring *r) { return r->cap - r->len; }
+static size_t ring_write(struct sham_ring *r, const void *src, size_t n) {
+    if (n > ring_free(r)) n = ring_free(r);
+    size_t tail = (r->head + r->len) % r->cap;
+    size_t first = n < r->cap - tail ? n : r->cap - tail;
+    memcpy(r->buf + tail, src, first);
+    memcpy(r->buf, (const char *)src + first, n - first);
+    r->len += n;
+    return n;
+}
+static size_t ring_read(struct sham_ring *r, void *dst, size_t n) {
+    if (n > r->len) n = r->len;
+    size_t first = n < r->cap - r->head ? n : r->cap - r->head;
+    memcpy(dst, r->buf + r->head, first);
+    memcpy((char *)dst + first, r->buf, n - first);
+    r->head = (r->head + n) % r->cap;
+    r->len -= n;
+    return n;
+}
+
+// ---------------- connection ----------------
+
+struct sent_slot {
+    int in_use;
+    struct sham_packet pkt;
+    ssize_t len;
+    long long sent_time_ms;
+    long long sent_us;         // first transmission, for RTT samples
+    bool retx;                 // retransmitted: no RTT sample (Karn)
+};
+
+// Received segment: past a hole it waits here for the hole to fill; with
+// FEC delivered segments are kept too, as inputs for rebuilding a neighbour
+struct rx_seg {
+    bool used;
+    uint32_t seq;
+    uint16_t len;
+    char data[SHAM_PAYLOAD] __attribute__((aligned(32)));
+};
+
+struct rx_parity {
+    bool used;
+    uint32_t base;             // first byte of the block
+    uint16_t span;             // block length in bytes
+    uint16_t k;
+    uint16_t xlen;             // XOR of the segment lengths
+    uint16_t plen;
+    char data[SHAM_PAYLOAD] __attribute__((aligned(32)));
+};
+
+// Per-stream state. Stream 0 queues in sndq/rcvq of the connection; the
+// rings of the other streams are allocated on first use.
+struct sham_stream {
+    struct sham_ring sq, rq;
+    uint32_t snd_off;          // stream offset of the next byte to segment
+    uint32_t rcv_off;          // next stream offset to deliver
+    int priority, weight;
+    long deficit;              // round-robin credit in bytes
+};
+
+struct sham_conn {
+    int sock;
+    int state;
+    int nonblock;
+    int busy_poll_us;          // spin this long before sleeping in poll()
+    double loss_rate;
+    int error;                 // errno to report once the connection died
+
+    struct sockaddr_in peer;
+    socklen_t peer_len;
+    bool have_peer;
+
+    // send side
+    uint32_t isn;              // our initial sequence number
+    uint32_t snd_una;          // oldest unacknowledged byte
+    uint32_t snd_nxt;          // next byte to put on the wire
+    uint16_t peer_wnd;         // last window advertised by the peer
+    struct sham_ring sndq;     // accepted from the app (compressed if zs), not yet segmented
+    struct sham_zsend *zs;     // compressor for our stream, NULL if off
+    struct sham_zstats zsyn;   // blocks compressed inline for sham_connect_data()
+    struct sent_slot slots[MAX_SENT_SLOTS];
+    int inflight;
+    bool cork;                 // hold back partial segments of stream 0 until flushed
+    bool streams_on;           // our data segments carry stream headers
+    int rr;                    // round-robin position among equal-priority streams
+    struct sham_stream streams[SHAM_MAX_STREAMS];
+
+    // FEC: parity of the block being sent accumulates in fec_pkt
+    int fec;                   // opts->fec: fixed k, SHAM_FEC_AUTO, or 0
+    int fec_k;                 // current k, 0 = no parity
+    int fec_cnt;               // segments in the current block
+    uint32_t fec_span;
+    uint16_t fec_xlen, fec_plen;
+    struct sham_packet fec_pkt __attribute__((aligned(32)));
+    double fec_loss;           // loss estimate driving SHAM_FEC_AUTO
+    uint64_t fec_mark_segs, fec_mark_lost;
+    uint64_t fec_holes;        // timeouts at snd_una: losses parity did not cover
+    bool fec_stalled;          // partial block already closed for this full window
+    uint32_t peer_rebuilt;     // reported back in the peer's ACKs
+
+    // pacing: token bucket refilled at pacing_rate bytes/s
+    int pacing;
+    bool kernel_pacing;        // SO_MAX_PACING_RATE accepted (the bucket still runs)
+    double kernel_rate;        // rate last handed to the kernel
+    double pacing_rate;
+    double tokens;
+    long long tokens_us;
+    long long pace_next_us;    // when the bucket next holds a full segment
+    long long srtt_us;
+
+    // receive side
+    uint32_t peer_isn;
+    uint32_t rcv_nxt;          // next expected byte from the peer
+    struct sham_ring rcvq;     // in-order bytes waiting for sham_recv()
+    uint16_t adv_wnd;          // last window we advertised
+    bool peer_compress;        // peer's stream arrives as compressed blocks
+    bool peer_fec;             // peer's stream carries parity
+    bool peer_streams;         // peer's data segments carry stream headers
+    struct rx_seg rxs[RX_SEGS];
+    struct rx_parity rxp[RX_PARITY];
+    int rx_parities;           // rxp entries in use
+    char *zraw;                // decoded block being handed to the app
+    uint32_t zraw_len, zraw_off;
+
+    // fast open
+    bool fastopen;             // client: send data in the SYN when a cookie is cached
+    char *fastopen_cache;
+    bool have_cookie;
+    uint8_t cookie[SHAM_COOKIE_LEN];
+    int syn_slot;              // slot holding the data carried by our SYN, or -1
+    bool send_cookie;          // server: peer asked for a cookie
+    bool synack_pending;       // server: fast-open peer has not acknowledged the SYN-ACK
+    uint8_t fo_key[16];        // server: cookie secret
+
+    // handshake / teardown
+    long long ctl_sent_ms;     // last SYN, SYN-ACK or FIN transmission
+    long long deadline_ms;     // give up on handshake or close after this
+    bool close_requested, fin_sent, fin_acked, active_close;
+    bool peer_fin;
+    uint32_t fin_seq, peer_fin_seq;
+    long long ctl_sent_us;
+
+    struct sham_stats stats;
+    long long established_ms;
+    long long done_ms;         // our FIN was acknowledged: all data delivered
+};
+
+// Any 32-bit value: the comparisons are wrap-safe, so no headroom is needed
+static uint32_t random_isn(void) {
+#ifdef SHAM_TEST
+    // Test builds only (make test-large): SHAM_ISN=<n> fixes the ISN so the
+    // sequence wraps early. Release builds never take the ISN from outside.
+    const char *fixed = getenv("SHAM_ISN");
+    if (fixed && *fixed) return (uint32_t)strtoul(fixed, NULL, 0);
+#endif
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+static ssize_t safe_sendto(struct sham_conn *c, const void *buf, size_t len) {
+    ssize_t r = sendto(c->sock, buf, len, 0, (struct sockaddr*)&c->peer, c->peer_len);
+    if (r < 0) perror("sendto");
+    return r;
+}
+
+static struct sham_ring *stream_sq(struct sham_conn *c, int sid) {
+    if (sid == 0) return &c->sndq;
+    struct sham_ring *q = &c->streams[sid].sq;
+    if (!q->buf && ring_init(q, SND_BUF_BYTES) < 0) return NULL;
+    return q;
+}
+
+static struct sham_ring *stream_rq(struct sham_conn *c, int sid) {
+    if (sid == 0) return &c->rcvq;
+    struct sham_ring *q = &c->streams[sid].rq;
+    if (!q->buf && ring_init(q, RCV_BUF_BYTES) < 0) return NULL;
+    return q;
+}
+
+// Bytes accepted on any stream but not yet segmented
+static size_t snd_queued(const struct sham_conn *c) {
+    size_t n = c->sndq.len;
+    for (int i = 1; i < SHAM_MAX_STREAMS; ++i) n += c->streams[i].sq.len;
+    return n;
+}
+
+// All streams share one receive budget; the window is what they leave free
+static uint16_t rcv_window(const struct sham_conn *c) {
+    size_t used = c->rcvq.len;
+    for (int i = 1; i < SHAM_MAX_STREAMS; ++i) used += c->streams[i].rq.len;
+    size_t w = used < RCV_BUF_BYTES ? RCV_BUF_BYTES - used : 0;
+    return w > 0xffff ? 0xffff : (uint16_t)w;
+}
+
+static void send_ctl(struct sham_conn *c, uint16_t flags, uint32_t seq, uint32_t ack) {
+    struct sham_header h;
+    h.seq_num = htonl(seq);
+    h.ack_num = htonl(ack);
+    h.flags = htons(flags);
+    c->adv_wnd = rcv_window(c);
+    h.window_size = htons(c->adv_wnd);
+    safe_sendto(c, &h, sizeof(h));
+}
+
+static void send_ack(struct sham_conn *c) {
+    send_ctl(c, SHAM_ACK, c->peer_fec ? (uint32_t)c->stats.fec_rebuilt : 0, c->rcv_nxt);
+    sham_log("SND ACK=%u WIN=%u", c->rcv_nxt, c->adv_wnd);
+}
+
+static struct sham_conn *conn_new(const struct sham_opts *opts) {
+    struct sham_conn *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (c->sock < 0 || ring_init(&c->sndq, SND_BUF_BYTES) < 0 || ring_init(&c->rcvq, RCV_BUF_BYTES) < 0) {
+        int e = errno;
+        if (c->sock >= 0) close(c->sock);
+        free(c->sndq.buf); free(c->rcvq.buf); free(c);
+        errno = e;
+        return NULL;
+    }
+    fcntl(c->sock, F_SETFL, O_NONBLOCK);
+    if (opts) {
+        c->nonblock = opts->nonblock;
+        c->loss_rate = opts->loss_rate;
+        c->pacing = opts->pacing;
+        c->fastopen = opts->fastopen;
+        if (opts->fastopen_cache) c->fastopen_cache = strdup(opts->fastopen_cache);
+        c->fec = opts->fec;
+        if (c->fec > FEC_MAX_K) c->fec = FEC_MAX_K;
+        if (c->fec < 0) c->fec = SHAM_FEC_AUTO;
+        c->fec_loss = FEC_INIT_LOSS;
+        c->fec_k = c->fec == SHAM_FEC_AUTO ? sham_fec_pick_k(c->fec_loss, FEC_MAX_K) : c->fec;
+        c->busy_poll_us = opts->busy_poll > 0 ? opts->busy_poll : 0;
+        c->streams_on = opts->streams != 0;
+#ifdef SO_BUSY_POLL
+        // Lets the kernel poll the device queue in recv() too; needs
+        // CAP_NET_ADMIN above net.core.busy_read, the spin below works regardless
+        if (c->busy_poll_us > 0 &&
+            setsockopt(c->sock, SOL_SOCKET, SO_BUSY_POLL, &c->busy_poll_us, sizeof(c->busy_poll_us)) < 0)
+            sham_log("SO_BUSY_POLL unavailable, spinning in user space only");
+#endif
+        if (opts->compress && !(c->zs = sham_zsend_new())) {
+            close(c->sock);
+            free(c->sndq.buf); free(c->rcvq.buf); free(c->fastopen_cache); free(c);
+            return NULL;
+        }
+    }
+    for (int i = 0; i < SHAM_MAX_STREAMS; ++i) c->streams[i].weight = 1;
+    c->syn_slot = -1;
+    c->peer_len = sizeof(c->peer);
+    c->peer_wnd = SHAM_PAYLOAD;
+    return c;
+}
+
+static void conn_free(struct sham_conn *c) {
+    close(c->sock);
+    free(c->sndq.buf);
+    free(c->rcvq.buf);
+    for (int i = 1; i < SHAM_MAX_STREAMS; ++i) {
+        free(c->streams[i].sq.buf);
+        free(c->streams[i].rq.buf);
+    }
+    free(c->fastopen_cache);
+    sham_zsend_free(c->zs);
+    free(c->zraw);
+    free(c);
+}
+
+void sham_opts_init(struct sham_opts *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->pacing = SHAM_PACE_USER;
+}
+
+// ---------------- pacing ----------------
+
+static void rtt_sample(struct sham_conn *c, long long sample_us) {
+    if (sample_us < 1) sample_us = 1;
+    if (c->srtt_us == 0) c->srtt_us = sample_us;
+    else c->srtt_us = (7 * c->srtt_us + sample_us) / 8;
+
+    if (c->pacing == SHAM_PACE_OFF) return;
+    double wnd = SND_WND_PACKETS * SHAM_PAYLOAD;
+    if (c->peer_wnd >= SHAM_PAYLOAD && c->peer_wnd < wnd) wnd = c->peer_wnd;
+    double rate = PACING_GAIN * wnd * 1e6 / (double)c->srtt_us;
+
+#ifdef SO_MAX_PACING_RATE
+    // Hand the rate to the kernel as well; only resync on a >1/8 change. Linux
+    // accepts the option whatever the qdisc, but only fq acts on it, so the
+    // token bucket keeps running as the backstop and fq, when present,
+    // spreads each released burst out packet by packet.
+    if (c->pacing == SHAM_PACE_KERNEL &&
+        (!c->kernel_pacing || rate > c->kernel_rate * 1.125 || rate < c->kernel_rate * 0.875)) {
+        unsigned int r = rate > 4e9 ? 4000000000u : (unsigned int)rate;
+        c->kernel_pacing = setsockopt(c->sock, SOL_SOCKET, SO_MAX_PACING_RATE, &r, sizeof(r)) == 0;
+        c->kernel_rate = rate;
+        if (!c->kernel_pacing) {
+            sham_log("SO_MAX_PACING_RATE unavailable, pacing in user space");
+            c->pacing = SHAM_PACE_USER;
+        }
+    }
+#else
+    if (c->pacing == SHAM_PACE_KERNEL) c->pacing = SHAM_PACE_USER;
+#endif
+    if (c->pacing_rate == 0) {
+        c->tokens = 2 * SHAM_PAYLOAD;
+        c->tokens_us = now_us();
+    }
+    c->pacing_rate = rate;
+}
+
+// Token bucket: true if n bytes may be released now
+static bool pacing_allows(struct sham_conn *c, size_t n) {
+    if (c->pacing == SHAM_PACE_OFF || c->pacing_rate <= 0) return true;
+    long long now = now_us();
+    c->tokens += (double)(now - c->tokens_us) * c->pacing_rate / 1e6;
+    c->tokens_us = now;
+    // Timers tick in milliseconds, so allow up to 1 ms worth of data per release
+    double burst = c->pacing_rate / 1000.0;
+    if (burst < 2 * SHAM_PAYLOAD) burst = 2 * SHAM_PAYLOAD;
+    if (c->tokens > burst) c->tokens = burst;
+    if (c->tokens < (double)n) {
+        c->pace_next_us = now + (long long)(((double)n - c->tokens) * 1e6 / c->pacing_rate) + 1;
+        return false;
+    }
+    c->tokens -= (double)n;
+    c->pace_next_us = 0;
+    return true;
+}
+
+// Send n bytes regardless of the bucket; the debt delays the data after it
+static void pacing_charge(struct sham_conn *c, size_t n) {
+    if (c->pacing == SHAM_PACE_OFF || c->pacing_rate <= 0) return;
+    pacing_allows(c, 0);
+    c->tokens -= (double)n;
+}
+
+// ---------------- fast open ----------------
+
+// Cookie = MD5(secret || client address), so only a client that has
+// received a SYN-ACK at its address can get data accepted in a SYN.
+static void make_cookie(const struct sham_conn *c, const struct sockaddr_in *addr, uint8_t *out) {
+    unsigned char digest[MD5_DIGEST_LENGTH];
+    MD5_CTX ctx;
+    MD5_Init(&ctx);
+    MD5_Update(&ctx, c->fo_key, sizeof(c->fo_key));
+    MD5_Update(&ctx, &addr->sin_addr, sizeof(addr->sin_addr));
+    MD5_Final(digest, &ctx);
+    memcpy(out, digest, SHAM_COOKIE_LEN);
+}
+
+// Server secret: kept in a file so cookies outlive the process
+static void load_fo_key(struct sham_conn *c, const char *path) {
+    FILE *f = path ? fopen(path, "rb") : NULL;
+    if (f) {
+        size_t r = fread(c->fo_key, 1, sizeof(c->fo_key), f);
+        fclose(f);
+        if (r == sizeof(c->fo_key)) return;
+    }
+    f = fopen("/dev/urandom", "rb");
+    if (!f || fread(c->fo_key, 1, sizeof(c->fo_key), f) != sizeof(c->fo_key)) {
+        for (size_t i = 0; i < sizeof(c->fo_key); ++i) c->fo_key[i] = (uint8_t)rand();
+    }
+    if (f) fclose(f);
+    if (path) {
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd >= 0) {
+            if (write(fd, c->fo_key, sizeof(c->fo_key)) != (ssize_t)sizeof(c->fo_key)) perror("write fastopen key");
+            close(fd);
+        }
+    }
+}
+
+// Client cookie cache: one "<ip> <hex cookie>" line per server
+static void cookie_load(struct sham_conn *c) {
+    if (!c->fastopen_cache) return;
+    FILE *f = fopen(c->fastopen_cache, "r");
+    if (!f) return;
+    char ip[INET_ADDRSTRLEN], want[INET_ADDRSTRLEN], hex[2 * SHAM_COOKIE_LEN + 1];
+    inet_ntop(AF_INET, &c->peer.sin_addr, want, sizeof(want));
+    while (fscanf(f, "%15s %16s", ip, hex) == 2) {
+        if (strcmp(ip, want) != 0 || strlen(hex) != 2 * SHAM_COOKIE_LEN) continue;
+        for (int i = 0; i < SHAM_COOKIE_LEN; ++i) {
+            unsigned int b;
+            sscanf(hex + 2 * i, "%2x", &b);
+            c->cookie[i] = (uint8_t)b;
+        }
+        c->have_cookie = true;
+    }
+    fclose(f);
+}
+
+static void cookie_save(const struct sham_conn *c) {
+    if (!c->fastopen_cache) return;
+    char ip[INET_ADDRSTRLEN], me[INET_ADDRSTRLEN], hex[2 * SHAM_COOKIE_LEN + 1];
+    char kept[8192];
+    size_t kept_len = 0;
+    inet_ntop(AF_INET, &c->peer.sin_addr, me, sizeof(me));
+
+    FILE *f = fopen(c->fastopen_cache, "r");
+    if (f) {
+        while (fscanf(f, "%15s %16s", ip, hex) == 2 && kept_len + 64 < sizeof(kept)) {
+            if (strcmp(ip, me) != 0) kept_len += (size_t)snprintf(kept + kept_len, sizeof(kept) - kept_len, "%s %s\n", ip, hex);
+        }
+        fclose(f);
+    }
+    f = fopen(c->fastopen_cache, "w");
+    if (!f) return;
+    fwrite(kept, 1, kept_len, f);
+    fprintf(f, "%s ", me);
+    for (int i = 0; i < SHAM_COOKIE_LEN; ++i) fprintf(f, "%02x", c->cookie[i]);
+    fprintf(f, "\n");
+    fclose(f);
+}
+
+// SYN: plain, a cookie request, or cookie + the data in syn_slot (+ FIN)
+static void send_syn(struct sham_conn *c) {
+    struct sham_packet p;
+    size_t plen = 0;
+    uint16_t flags = SHAM_SYN;
+    if (c->zs) flags |= SHAM_COMPRESS;
+    if (c->fec) flags |= SHAM_FEC;
+    if (c->streams_on) flags |= SHAM_STREAM;
+    if (c->fastopen) {
+        flags |= SHAM_COOKIE;
+        if (c->have_cookie) {
+            memcpy(p.data, c->cookie, SHAM_COOKIE_LEN);
+            plen = SHAM_COOKIE_LEN;
+            if (c->syn_slot >= 0) {
+                const struct sent_slot *s = &c->slots[c->syn_slot];
+                size_t n = (size_t)s->len - sizeof(struct sham_header);
+                memcpy(p.data + plen, s->pkt.data, n);
+                plen += n;
+            }
+            if (c->fin_sent) flags |= SHAM_FIN;
+        }
+    }
+    p.hdr.seq_num = htonl(c->isn);
+    p.hdr.ack_num = 0;
+    p.hdr.flags = htons(flags);
+    c->adv_wnd = rcv_window(c);
+    p.hdr.window_size = htons(c->adv_wnd);
+    safe_sendto(c, &p, sizeof(struct sham_header) + plen);
+    if (plen > 0) sham_log("SND SYN SEQ=%u COOKIE DATA LEN=%zu%s", c->isn, plen - SHAM_COOKIE_LEN, c->fin_sent ? " FIN" : "");
+    else sham_log("SND SYN SEQ=%u", c->isn);
+}
+
+static void send_synack(struct sham_conn *c) {
+    struct sham_packet p;
+    size_t plen = 0;
+    uint16_t flags = SHAM_SYN | SHAM_ACK;
+    if (c->zs) flags |= SHAM_COMPRESS;
+    if (c->fec) flags |= SHAM_FEC;
+    if (c->streams_on) flags |= SHAM_STREAM;
+    if (c->send_cookie) {
+        make_cookie(c, &c->peer, (uint8_t *)p.data);
+        plen = SHAM_COOKIE_LEN;
+        flags |= SHAM_COOKIE;
+    }
+    p.hdr.seq_num = htonl(c->isn);
+    p.hdr.ack_num = htonl(c->rcv_nxt);
+    p.hdr.flags = htons(flags);
+    c->adv_wnd = rcv_window(c);
+    p.hdr.window_size = htons(c->adv_wnd);
+    safe_sendto(c, &p, sizeof(struct sham_header) + plen);
+    sham_log("SND SYN-ACK SEQ=%u ACK=%u", c->isn, c->rcv_nxt);
+}
+
+// ---------------- sender ----------------
+
+// Move compressed blocks from the worker into the send queue
+static void drain_compressor(struct sham_conn *c) {
+    if (!c->zs) return;
+    // A partial block is sealed once the sender has nothing else to do, so
+    // small writes go out without waiting for 32 KB or a close
+    if (c->close_requested || (!c->cork && c->sndq.len == 0 && c->inflight == 0))
+        sham_zsend_flush(c->zs);
+    char tmp[4096];
+    size_t n;
+    while (ring_free(&c->sndq) > 0) {
+        size_t want = ring_free(&c->sndq) < sizeof(tmp) ? ring_free(&c->sndq) : sizeof(tmp);
+        if ((n = sham_zsend_read(c->zs, tmp, want)) == 0) break;
+        ring_write(&c->sndq, tmp, n);
+    }
+}
+
+// Parity of the current block goes out unreliably; it is never retransmitted
+static void fec_flush(struct sham_conn *c) {
+    if (c->fec_cnt == 0) return;
+    struct sham_packet *p = &c->fec_pkt;
+    uint32_t base = ntohl(p->hdr.seq_num);
+    p->hdr.ack_num = htonl((uint32_t)c->fec_cnt << 16 | c->fec_xlen);
+    p->hdr.flags = htons(SHAM_FEC);
+    p->hdr.window_size = htons((uint16_t)c->fec_span);
+    safe_sendto(c, p, sizeof(struct sham_header) + c->fec_plen);
+    sham_log("SND FEC SEQ=%u K=%d LEN=%u", base, c->fec_cnt, (unsigned)c->fec_span);
+    // Parity is paced like data; the bucket may go into debt for it
+    if (c->pacing_rate > 0) c->tokens -= c->fec_plen;
+    c->stats.fec_parity++;
+    c->fec_cnt = 0;
+}
+
+static void fec_add(struct sham_conn *c, const char *data, size_t n, uint32_t seq) {
+    if (c->fec_k <= 0) return;
+    if (c->fec_cnt == 0) {
+        c->fec_pkt.hdr.seq_num = htonl(seq);
+        memset(c->fec_pkt.data, 0, sizeof(c->fec_pkt.data));
+        c->fec_span = 0;
+        c->fec_xlen = 0;
+        c->fec_plen = 0;
+    }
+    sham_fec_xor(c->fec_pkt.data, data, n);
+    c->fec_span += (uint32_t)n;
+    c->fec_xlen ^= (uint16_t)n;
+    if (n > c->fec_plen) c->fec_plen = (uint16_t)n;
+    if (++c->fec_cnt >= c->fec_k) fec_flush(c);
+}
+
+// SHAM_FEC_AUTO: every FEC_EPOCH segments, estimate loss from what parity
+// rebuilt (the peer's count) plus what it missed (timeouts), and pick k
+static void fec_adapt(struct sham_conn *c) {
+    if (c->fec != SHAM_FEC_AUTO) return;
+    uint64_t segs = c->stats.segs_sent - c->fec_mark_segs;
+    if (segs < FEC_EPOCH) return;
+    uint64_t lost = c->fec_holes + c->peer_rebuilt;
+    double sample = (double)(lost - c->fec_mark_lost) / (double)segs;
+    c->fec_loss = 0.75 * c->fec_loss + 0.25 * sample;
+    c->fec_mark_segs = c->stats.segs_sent;
+    c->fec_mark_lost = lost;
+    int k = sham_fec_pick_k(c->fec_loss, FEC_MAX_K);
+    if (k != c->fec_k) {
+        sham_log("FEC K=%d LOSS=%.4f", k, c->fec_loss);
+        fec_flush(c);
+        c->fec_k = k;
+    }
+}
+
+// Stream data bytes one segment can carry
+static size_t seg_room(const struct sham_conn *c) {
+    return c->streams_on ? SHAM_PAYLOAD - STREAM_HDR : SHAM_PAYLOAD;
+}
+
+static bool stream_ready(const struct sham_conn *c, int sid) {
+    size_t len = sid == 0 ? c->sndq.len : c->streams[sid].sq.len;
+    if (len == 0) return false;
+    return sid != 0 || !c->cork || c->close_requested || len >= seg_room(c);
+}
+
+// Next stream to segment: the highest priority with data ready, and among
+// equal priorities deficit round robin worth DRR_QUANTUM bytes per weight
+static int sched_pick(struct sham_conn *c) {
+    if (!c->streams_on) return stream_ready(c, 0) ? 0 : -1;
+    int best = -1;
+    for (int i = 0; i < SHAM_MAX_STREAMS; ++i) {
+        if (!stream_ready(c, i)) { c->streams[i].deficit = 0; continue; }
+        if (best < 0 || c->streams[i].priority > c->streams[best].priority) best = i;
+    }
+    if (best < 0) return -1;
+    int prio = c->streams[best].priority;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int j = 0; j < SHAM_MAX_STREAMS; ++j) {
+            int i = (c->rr + j) % SHAM_MAX_STREAMS;
+            struct sham_stream *st = &c->streams[i];
+            if (st->priority == prio && st->deficit > 0 && stream_ready(c, i)) {
+                c->rr = i;
+                return i;
+            }
+        }
+        for (int i = 0; i < SHAM_MAX_STREAMS; ++i)
+            if (c->streams[i].priority == prio && stream_ready(c, i))
+                c->streams[i].deficit += (long)DRR_QUANTUM * c->streams[i].weight;
+    }
+    return best;
+}
+
+// Build the segment at snd_nxt in slot s from n bytes of stream sid.
+// Returns the payload length, stream header included.
+static size_t make_segment(struct sham_conn *c, struct sent_slot *s, int sid, size_t n) {
+    size_t hl = 0;
+    s->pkt.hdr.seq_num = htonl(c->snd_nxt);
+    s->pkt.hdr.ack_num = 0;
+    s->pkt.hdr.flags = htons(c->streams_on ? SHAM_STREAM : 0);
+    s->pkt.hdr.window_size = htons(rcv_window(c));
+    if (c->streams_on) {
+        struct sham_stream *st = &c->streams[sid];
+        struct sham_stream_hdr sh;
+        sh.stream_id = htons((uint16_t)sid);
+        sh.reserved = 0;
+        sh.offset = htonl(st->snd_off);
+        memcpy(s->pkt.data, &sh, STREAM_HDR);
+        hl = STREAM_HDR;
+        st->snd_off += (uint32_t)n;
+        st->deficit -= (long)n;
+        if (st->deficit <= 0) c->rr = (sid + 1) % SHAM_MAX_STREAMS;
+    }
+    ring_read(stream_sq(c, sid), s->pkt.data + hl, n);
+    s->len = (ssize_t)(sizeof(struct sham_header) + hl + n);
+    return hl + n;
+}
+
+static void fill_window(struct sham_conn *c) {
+    drain_compressor(c);
+    if (c->state != SHAM_ESTABLISHED) return;
+
+    int sid;
+    while (c->inflight < SND_WND_PACKETS + CTRL_EXTRA_PACKETS && (sid = sched_pick(c)) >= 0) {
+        // Priority streams may run a little past the window and skip pacing
+        bool urgent = c->streams_on && c->streams[sid].priority > 0;
+        if (!urgent && c->inflight >= SND_WND_PACKETS) break;
+        size_t hl = SHAM_PAYLOAD - seg_room(c);
+        size_t n = stream_sq(c, sid)->len;
+        if (n > seg_room(c)) n = seg_room(c);
+        uint32_t outstanding = c->snd_nxt - c->snd_una;
+        // Respect the peer's receive window; with nothing in flight one
+        // segment is always allowed so a closed window gets probed.
+        if (c->inflight > 0 && outstanding + hl + n > c->peer_wnd) break;
+        if (c->inflight == 0 && c->peer_wnd > hl && hl + n > c->peer_wnd) n = c->peer_wnd - hl;
+
+        int slot = -1;
+        for (int i = 0; i < MAX_SENT_SLOTS; ++i) if (!c->slots[i].in_use) { slot = i; break; }
+        if (slot == -1) break;
+        if (urgent) pacing_charge(c, hl + n);
+        else if (!pacing_allows(c, hl + n)) break;
+
+        struct sent_slot *s = &c->slots[slot];
+        n = make_segment(c, s, sid, n);
+        safe_sendto(c, &s->pkt, s->len);
+        sham_log("SND DATA SEQ=%u LEN=%zu", c->snd_nxt, n);
+        s->in_use = 1;
+        s->retx = false;
+        s->sent_time_ms = now_ms();
+        s->sent_us = now_us();
+
+        c->snd_nxt += (uint32_t)n;
+        c->inflight++;
+        c->stats.segs_sent++;
+        c->stats.bytes_sent += n;
+        fec_add(c, s->pkt.data, n, ntohl(s->pkt.hdr.seq_num));
+        fec_adapt(c);
+    }
+    // Close a partial block once nothing more can go out for a while, so the
+    // tail of a burst is covered before the sender stalls on the window. Only
+    // once per stall: while the window stays full, ACKs release one segment
+    // at a time and each would otherwise get a parity of its own.
+    bool full = c->inflight >= SND_WND_PACKETS;
+    if (c->fec_cnt > 0 && ((full && !c->fec_stalled) ||
+                           (snd_queued(c) == 0 && (!c->cork || c->close_requested)))) {
+        fec_flush(c);
+        c->fec_stalled = full;
+    }
+    if (!full) c->fec_stalled = false;
+
+    // FIN goes out once everything queued before sham_close() is acknowledged
+    if (c->close_requested && !c->fin_sent && snd_queued(c) == 0 && c->inflight == 0 &&
+        !(c->zs && sham_zsend_busy(c->zs))) {
+        c->fin_seq = c->snd_nxt;
+        send_ctl(c, SHAM_FIN, c->fin_seq, 0);
+        sham_log("SND FIN SEQ=%u", c->fin_seq);
+        c->pace_next_us = 0;
+        c->fin_sent = true;
+        c->active_close = !c->peer_fin;
+        c->ctl_sent_ms = now_ms();
+        // The passive side sends the last FIN. All its data is acknowledged
+        // and the peer may already be gone, so if the final ACK is lost, one
+        // retransmission is all it waits for.
+        c->deadline_ms = c->ctl_sent_ms + (c->active_close ? CLOSE_TIMEOUT_MS : 2 * RTO_MS + 1);
+    }
+}
+
+// Both FINs acknowledged. The active side does not linger: the passive side
+// is the one that waits out a lost final ACK, so the closer returns at once.
+static void update_close_state(struct sham_conn *c) {
+    if (c->state != SHAM_ESTABLISHED || !c->fin_acked || !c->peer_fin) return;
+    c->state = SHAM_CLOSED;
+}
+
+// ---------------- receiver ----------------
+
+static void handle_ack(struct sham_conn *c, uint32_t ackn, uint16_t wnd) {
+    c->peer_wnd = wnd;
+    bool fin_ack = c->fin_sent && ackn == c->fin_seq + 1;
+    if (fin_ack) ackn = c->fin_seq;   // a fast-open SYN-ACK can cover data and FIN at once
+    else sham_log("RCV ACK=%u", ackn);
+    if (SEQ_GT(ackn, c->snd_una) && SEQ_LEQ(ackn, c->snd_nxt)) {
+        long long sample_us = -1;
+        bool hole = false;         // this ACK also covers a retransmitted segment
+        for (int i = 0; i < MAX_SENT_SLOTS; ++i) if (c->slots[i].in_use) {
+            uint32_t pseq = ntohl(c->slots[i].pkt.hdr.seq_num);
+            uint32_t plen = (uint32_t)(c->slots[i].len - (ssize_t)sizeof(struct sham_header));
+            if (SEQ_LEQ(pseq + plen, ackn)) {
+                if (c->slots[i].retx) hole = true;
+                else if (pseq + plen == ackn) sample_us = now_us() - c->slots[i].sent_us;
+                c->slots[i].in_use = 0;
+                c->inflight--;
+            }
+        }
+        c->stats.bytes_acked += ackn - c->snd_una;
+        c->snd_una = ackn;
+        // After a hole the ACK was held back until the retransmission arrived,
+        // so the sample would include the RTO (Karn)
+        if (sample_us >= 0 && !hole) rtt_sample(c, sample_us);
+    }
+    if (fin_ack) {
+        if (!c->fin_acked) {
+            sham_log("RCV ACK FOR FIN");
+            c->done_ms = now_ms();
+        }
+        c->fin_acked = true;
+        update_close_state(c);
+    }
+}
+
+static void handle_fin(struct sham_conn *c, uint32_t seq) {
+    if (c->peer_fin && seq == c->peer_fin_seq) {
+        // Our ACK for it was lost
+        send_ctl(c, SHAM_ACK, 0, seq + 1);
+        sham_log("SND ACK FOR FIN");
+        return;
+    }
+    if (c->peer_fin || seq != c->rcv_nxt) {
+        // Data before the FIN is still missing
+        send_ack(c);
+        return;
+    }
+    sham_log("RCV FIN SEQ=%u", seq);
+    c->peer_fin = true;
+    c->peer_fin_seq = seq;
+    c->rcv_nxt = seq + 1;
+    send_ctl(c, SHAM_ACK, 0, c->rcv_nxt);
+    sham_log("SND ACK FOR FIN");
+    update_close_state(c);
+}
+
+static struct rx_seg *rx_find(struct sham_conn *c, uint32_t seq) {
+    for (int i = 0; i < RX_SEGS; ++i)
+        if (c->rxs[i].used && c->rxs[i].seq == seq) return &c->rxs[i];
+    return NULL;
+}
+
+// Copy a segment into rxs, reusing the oldest delivered entry if full
+static bool rx_keep(struct sham_conn *c, const char *data, uint32_t seq, size_t len) {
+    struct rx_seg *slot = NULL;
+    for (int i = 0; i < RX_SEGS && !slot; ++i) if (!c->rxs[i].used) slot = &c->rxs[i];
+    if (!slot) {
+        // Search all entries: the oldest delivered one is least likely to
+        // belong to a block whose parity is still on its way
+        for (int i = 0; i < RX_SEGS; ++i) {
+            struct rx_seg *r = &c->rxs[i];
+            if (SEQ_LEQ(r->seq + r->len, c->rcv_nxt) && (!slot || SEQ_LT(r->seq, slot->seq))) slot = r;
+        }
+        if (!slot) return false;
+    }
+    slot->used = true;
+    slot->seq = seq;
+    slot->len = (uint16_t)len;
+    memcpy(slot->data, data, len);
+    return true;
+}
+
+// Hand a segment with a stream header to its stream if it is the next one
+// there. True once its data has been delivered, now or before.
+static bool stream_deliver(struct sham_conn *c, const char *data, size_t len) {
+    struct sham_stream_hdr sh;
+    if (len < STREAM_HDR) return true;   // malformed, skip it
+    memcpy(&sh, data, STREAM_HDR);
+    int sid = ntohs(sh.stream_id);
+    if (sid >= SHAM_MAX_STREAMS) return true;
+    struct sham_stream *st = &c->streams[sid];
+    uint32_t off = ntohl(sh.offset);
+    if (SEQ_LT(off, st->rcv_off)) return true;
+    struct sham_ring *q = stream_rq(c, sid);
+    size_t n = len - STREAM_HDR;
+    if (off != st->rcv_off || !q || n > ring_free(q)) return false;
+    ring_write(q, data + STREAM_HDR, n);
+    st->rcv_off += (uint32_t)n;
+    c->stats.bytes_received += n;
+    return true;
+}
+
+// Hand over segments that have become in-order. With streams, segments past
+// a hole are delivered as soon as their own stream is complete up to them.
+static void rx_drain(struct sham_conn *c) {
+    struct rx_seg *r;
+    if (c->peer_streams) {
+        bool more = true;
+        while (more) {
+            more = false;
+            for (int i = 0; i < RX_SEGS; ++i) {
+                r = &c->rxs[i];
+                if (!r->used || r->len <= STREAM_HDR || SEQ_LT(r->seq, c->rcv_nxt)) continue;
+                struct sham_stream_hdr sh;
+                memcpy(&sh, r->data, STREAM_HDR);
+                int sid = ntohs(sh.stream_id);
+                if (sid < SHAM_MAX_STREAMS && ntohl(sh.offset) == c->streams[sid].rcv_off &&
+                    stream_deliver(c, r->data, r->len))
+                    more = true;
+            }
+        }
+    }
+    while ((r = rx_find(c, c->rcv_nxt)) != NULL) {
+        if (c->peer_streams) {
+            if (!stream_deliver(c, r->data, r->len)) break;
+        } else {
+            if (r->len > ring_free(&c->rcvq)) break;
+            ring_write(&c->rcvq, r->data, r->len);
+            c->stats.bytes_received += r->len;
+        }
+        c->rcv_nxt += r->len;
+        if (!c->peer_fec) r->used = false;
+    }
+}
+
+static void rx_insert(struct sham_conn *c, const char *data, uint32_t seq, size_t len) {
+    uint32_t off = seq - c->rcv_nxt;
+    if (c->peer_streams) {
+        // Every segment passes through rxs so the connection sequence can
+        // advance over it once the segments before it are in
+        if (off < RCV_BUF_BYTES && !rx_find(c, seq) && rx_keep(c, data, seq, len)) rx_drain(c);
+    } else if (off == 0 && len <= ring_free(&c->rcvq)) {
+        ring_write(&c->rcvq, data, len);
+        c->rcv_nxt += (uint32_t)len;
+        c->stats.bytes_received += len;
+        if (c->peer_fec) rx_keep(c, data, seq, len);
+        rx_drain(c);
+    } else if (off > 0 && off < RCV_BUF_BYTES && off + len <= ring_free(&c->rcvq) && !rx_find(c, seq)) {
+        rx_keep(c, data, seq, len);   // past a hole
+    }
+}
+
+// Rebuild the one missing segment of any block whose other k-1 segments are here
+static bool fec_try(struct sham_conn *c) {
+    bool rebuilt = false, again = c->rx_parities > 0;
+    while (again) {
+        again = false;
+        for (int i = 0; i < RX_PARITY; ++i) {
+            struct rx_parity *p = &c->rxp[i];
+            if (!p->used) continue;
+            if (SEQ_LEQ(p->base + p->span, c->rcv_nxt)) {   // block complete
+                p->used = false;
+                c->rx_parities--;
+                continue;
+            }
+            int found = 0;
+            uint32_t sum = 0;
+            uint16_t xl = 0;
+            for (int j = 0; j < RX_SEGS; ++j) {
+                const struct rx_seg *r = &c->rxs[j];
+                if (r->used && r->seq - p->base < p->span) { found++; sum += r->len; xl ^= r->len; }
+            }
+            if (found != p->k - 1) continue;
+            p->used = false;
+            c->rx_parities--;
+            uint16_t mlen = p->xlen ^ xl;
+            if (mlen == 0 || mlen > p->plen || sum + mlen != p->span) continue;
+
+            // The hole is where walking the block from its start finds no segment
+            uint32_t pos = p->base;
+            const struct rx_seg *r;
+            while ((r = rx_find(c, pos)) != NULL) pos += r->len;
+            for (int j = 0; j < RX_SEGS; ++j) {
+                r = &c->rxs[j];
+                if (r->used && r->seq - p->base < p->span) sham_fec_xor(p->data, r->data, r->len);
+            }
+            sham_log("FEC REBUILT SEQ=%u LEN=%u", pos, (unsigned)mlen);
+            c->stats.fec_rebuilt++;
+            rx_insert(c, p->data, pos, mlen);
+            rebuilt = again = true;
+        }
+    }
+    return rebuilt;
+}
+
+static void handle_parity(struct sham_conn *c, const struct sham_packet *pkt, size_t len) {
+    uint32_t base = ntohl(pkt->hdr.seq_num);
+    uint32_t meta = ntohl(pkt->hdr.ack_num);
+    uint16_t span = ntohs(pkt->hdr.window_size);
+    uint16_t k = (uint16_t)(meta >> 16);
+    sham_log("RCV FEC SEQ=%u K=%u LEN=%u", base, (unsigned)k, (unsigned)span);
+    if (c->peer_fin || k == 0 || k > RX_SEGS || span == 0 ||
+        SEQ_LEQ(base + span, c->rcv_nxt)) return;
+
+    struct rx_parity *p = NULL;
+    for (int i = 0; i < RX_PARITY && !p; ++i) if (!c->rxp[i].used) p = &c->rxp[i];
+    if (!p) {
+        // Evict the oldest block; its segments have most likely been retransmitted
+        p = &c->rxp[0];
+        for (int i = 1; i < RX_PARITY; ++i) if (SEQ_LT(c->rxp[i].base, p->base)) p = &c->rxp[i];
+        c->rx_parities--;
+    }
+    p->used = true;
+    p->base = base;
+    p->span = span;
+    p->k = k;
+    p->xlen = (uint16_t)meta;
+    p->plen = (uint16_t)len;
+    memcpy(p->data, pkt->data, len);
+    memset(p->data + len, 0, sizeof(p->data) - len);
+    c->rx_parities++;
+    if (fec_try(c)) send_ack(c);
+}
+
+static void handle_data(struct sham_conn *c, const char *data, uint32_t seq, size_t len) {
+    sham_log("RCV DATA SEQ=%u LEN=%zu", seq, len);
+    if (!c->peer_fin) {
+        rx_insert(c, data, seq, len);
+        fec_try(c);
+    }
+    send_ack(c);
+}
+
+static void established(struct sham_conn *c) {
+    c->state = SHAM_ESTABLISHED;
+    c->established_ms = now_ms();
+    // The handshake gives the first RTT sample
+    rtt_sample(c, now_us() - c->ctl_sent_us);
+    if (c->fin_sent) c->deadline_ms = c->established_ms + CLOSE_TIMEOUT_MS;
+}
+
+static void accept_syn(struct sham_conn *c, const struct sham_packet *pkt, size_t data_len,
+                       const struct sockaddr_in *from) {
+    uint16_t flags = ntohs(pkt->hdr.flags);
+    uint32_t seq = ntohl(pkt->hdr.seq_num);
+    c->peer = *from;
+    c->peer_len = sizeof(*from);
+    c->have_peer = true;
+    c->peer_isn = seq;
+    c->rcv_nxt = seq + 1;
+    c->peer_compress = (flags & SHAM_COMPRESS) != 0;
+    c->peer_fec = (flags & SHAM_FEC) != 0;
+    c->peer_streams = (flags & SHAM_STREAM) != 0;
+    sham_log("RCV SYN SEQ=%u%s%s%s", seq, c->peer_compress ? " COMPRESS" : "", c->peer_fec ? " FEC" : "",
+             c->peer_streams ? " STREAMS" : "");
+
+    c->isn = random_isn();
+    c->snd_una = c->snd_nxt = c->isn + 1;
+
+    bool fast = false;
+    c->send_cookie = false;
+    if (flags & SHAM_COOKIE) {
+        uint8_t expect[SHAM_COOKIE_LEN];
+        make_cookie(c, from, expect);
+        if (data_len >= SHAM_COOKIE_LEN && memcmp(pkt->data, expect, SHAM_COOKIE_LEN) == 0) {
+            // Valid cookie: the SYN's data (and FIN) count as received already
+            size_t n = data_len - SHAM_COOKIE_LEN;
+            fast = true;
+            if (c->peer_streams) {
+                stream_deliver(c, pkt->data + SHAM_COOKIE_LEN, n);
+            } else {
+                ring_write(&c->rcvq, pkt->data + SHAM_COOKIE_LEN, n);
+                c->stats.bytes_received += n;
+            }
+            c->rcv_nxt += (uint32_t)n;
+            sham_log("RCV SYN COOKIE OK DATA LEN=%zu", n);
+            if (flags & SHAM_FIN) {
+                sham_log("RCV FIN SEQ=%u", c->rcv_nxt);
+                c->peer_fin = true;
+                c->peer_fin_seq = c->rcv_nxt;
+                c->rcv_nxt += 1;
+            }
+        } else {
+            if (data_len > 0) sham_log("RCV SYN BAD COOKIE, DATA IGNORED");
+            c->send_cookie = true;
+        }
+    }
+
+    send_synack(c);
+    c->ctl_sent_ms = now_ms();
+    c->ctl_sent_us = now_us();
+    c->deadline_ms = c->ctl_sent_ms + HANDSHAKE_TIMEOUT_MS;
+    if (fast) {
+        // Readable at once; the SYN-ACK is repeated until the peer acknowledges it
+        c->state = SHAM_ESTABLISHED;
+        c->established_ms = c->ctl_sent_ms;
+        c->synack_pending = true;
+    } else {
+        c->state = SHAM_SYN_RCVD;
+    }
+}
+
+static void handle_packet(struct sham_conn *c, const struct sham_packet *pkt, size_t len,
+                          const struct sockaddr_in *from) {
+    uint16_t flags = ntohs(pkt->hdr.flags);
+    uint32_t seq = ntohl(pkt->hdr.seq_num);
+    uint32_t ackn = ntohl(pkt->hdr.ack_num);
+    size_t data_len = len - sizeof(struct sham_header);
+
+    if (c->state == SHAM_LISTEN) {
+        if ((flags & SHAM_SYN) && !(flags & SHAM_ACK)) accept_syn(c, pkt, data_len, from);
+        return;
+    }
+    if (c->have_peer && (from->sin_addr.s_addr != c->peer.sin_addr.s_addr ||
+                         from->sin_port != c->peer.sin_port)) return;
+
+    if (flags & SHAM_SYN) {
+        // A fast-open SYN-ACK may also acknowledge the SYN's data and FIN
+        uint32_t syn_span = c->snd_nxt - (c->isn + 1) + (c->fin_sent ? 1 : 0);
+        if ((flags & SHAM_ACK) && c->state == SHAM_SYN_SENT && ackn - (c->isn + 1) <= syn_span) {
+            c->peer_isn = seq;
+            c->rcv_nxt = seq + 1;
+            c->peer_compress = (flags & SHAM_COMPRESS) != 0;
+            c->peer_fec = (flags & SHAM_FEC) != 0;
+            c->peer_streams = (flags & SHAM_STREAM) != 0;
+            sham_log("RCV SYN-ACK SEQ=%u ACK=%u", seq, ackn);
+            if ((flags & SHAM_COOKIE) && data_len >= SHAM_COOKIE_LEN) {
+                memcpy(c->cookie, pkt->data, SHAM_COOKIE_LEN);
+                c->have_cookie = true;
+                cookie_save(c);
+                sham_log("RCV COOKIE");
+            }
+            send_ctl(c, SHAM_ACK, 0, c->rcv_nxt);
+            sham_log("SND ACK FOR SYN");
+            established(c);
+            handle_ack(c, ackn, ntohs(pkt->hdr.window_size));
+            if (c->syn_slot >= 0 && c->slots[c->syn_slot].in_use) {
+                // Server did not take the SYN's data: resend it as a normal segment now
+                struct sent_slot *sl = &c->slots[c->syn_slot];
+                sham_log("SYN DATA NOT ACCEPTED, SND DATA SEQ=%u LEN=%ld", ntohl(sl->pkt.hdr.seq_num),
+                         (long)(sl->len - (ssize_t)sizeof(struct sham_header)));
+                safe_sendto(c, &sl->pkt, sl->len);
+                sl->sent_time_ms = now_ms();
+                sl->retx = true;
+                c->stats.segs_retx++;
+                if (c->fin_sent) {
+                    // The FIN that rode in the SYN was dropped with the data
+                    send_ctl(c, SHAM_FIN, c->fin_seq, 0);
+                    sham_log("SND FIN SEQ=%u", c->fin_seq);
+                    c->ctl_sent_ms = now_ms();
+                }
+            }
+            c->syn_slot = -1;
+        } else if ((flags & SHAM_ACK) && c->state >= SHAM_ESTABLISHED && seq == c->peer_isn) {
+            // Our handshake ACK was lost
+            send_ctl(c, SHAM_ACK, 0, c->peer_isn + 1);
+            sham_log("SND ACK FOR SYN");
+        } else if (!(flags & SHAM_ACK) && (c->state == SHAM_SYN_RCVD || c->synack_pending) &&
+                   seq == c->peer_isn) {
+            send_synack(c);
+        }
+        return;
+    }
+
+    if (c->synack_pending) {
+        // Anything but a SYN shows the fast-open peer got our SYN-ACK
+        c->synack_pending = false;
+        if ((flags & SHAM_ACK) && ackn == c->isn + 1) {
+            sham_log("RCV ACK FOR SYN");
+            rtt_sample(c, now_us() - c->ctl_sent_us);
+        }
+    }
+
+    if (c->state == SHAM_SYN_RCVD) {
+        if ((flags & SHAM_ACK) && ackn == c->isn + 1) {
+            sham_log("RCV ACK FOR SYN");
+            c->peer_wnd = ntohs(pkt->hdr.window_size);
+            established(c);
+            return;
+        }
+        // Data or FIN means the handshake ACK was lost but the peer is established
+        if (flags & SHAM_ACK) return;
+        established(c);
+    }
+    if (c->state != SHAM_ESTABLISHED) return;
+
+    if (c->loss_rate > 0.0 && data_len > 0 && !(flags & (SHAM_SYN|SHAM_ACK|SHAM_FIN))) {
+        if (((double)rand() / RAND_MAX) < c->loss_rate) {
+            sham_log("DROP DATA SEQ=%u", seq);
+            return;
+        }
+    }
+
+    if (flags & SHAM_ACK) {
+        // ACKs for our parity-protected stream report the peer's rebuild count
+        if (c->fec && !(flags & SHAM_FIN) && SEQ_GT(seq, c->peer_rebuilt)) c->peer_rebuilt = seq;
+        handle_ack(c, ackn, ntohs(pkt->hdr.window_size));
+    }
+    if (flags & SHAM_FIN) handle_fin(c, seq);
+    else if (flags & SHAM_FEC) { if (data_len > 0) handle_parity(c, pkt, data_len); }
+    else if (data_len > 0) handle_data(c, pkt->data, seq, data_len);
+}
+
+// ---------------- timers ----------------
+
+static void check_timers(struct sham_conn *c) {
+    long long now = now_ms();
+    switch (c->state) {
+    case SHAM_SYN_SENT:
+        if (now >= c->deadline_ms) {
+            c->state = SHAM_CLOSED;
+            c->error = ETIMEDOUT;
+        } else if (now - c->ctl_sent_ms >= RTO_MS) {
+            sham_log("TIMEOUT, RETX SYN SEQ=%u", c->isn);
+            send_syn(c);
+            c->ctl_sent_ms = now;
+        }
+        break;
+    case SHAM_SYN_RCVD:
+        if (now >= c->deadline_ms) {
+            // Peer went away mid-handshake, wait for a new one
+            c->state = SHAM_LISTEN;
+            c->have_peer = false;
+        } else if (now - c->ctl_sent_ms >= RTO_MS) {
+            sham_log("TIMEOUT, RETX SYN-ACK SEQ=%u", c->isn);
+            send_synack(c);
+            c->ctl_sent_ms = now;
+        }
+        break;
+    case SHAM_ESTABLISHED:
+        if (c->synack_pending && now - c->ctl_sent_ms >= RTO_MS) {
+            sham_log("TIMEOUT, RETX SYN-ACK SEQ=%u", c->isn);
+            send_synack(c);
+            c->ctl_sent_ms = now;
+        }
+        for (int i = 0; i < MAX_SENT_SLOTS; ++i) if (c->slots[i].in_use) {
+            struct sent_slot *s = &c->slots[i];
+            if (now - s->sent_time_ms > RTO_MS) {
+                uint32_t seq = ntohl(s->pkt.hdr.seq_num);
+                sham_log("TIMEOUT SEQ=%u", seq);
+                if (seq == c->snd_una) c->fec_holes++;
+                safe_sendto(c, &s->pkt, s->len);
+                s->sent_time_ms = now;
+                s->retx = true;
+                c->stats.segs_retx++;
+                sham_log("RETX DATA SEQ=%u LEN=%ld", seq, (long)(s->len - (ssize_t)sizeof(struct sham_header)));
+            }
+        }
+        if (c->fin_sent) {
+            if (now >= c->deadline_ms) {
+                if (c->active_close) sham_log("TIMEOUT waiting for FIN exchange, closing.");
+                else sham_log("FIN NOT ACKED, PEER HAS CLOSED, closing.");
+                c->state = SHAM_CLOSED;
+            } else if (!c->fin_acked && now - c->ctl_sent_ms > RTO_MS) {
+                sham_log("TIMEOUT on FIN, RETX FIN SEQ=%u", c->fin_seq);
+                send_ctl(c, SHAM_FIN, c->fin_seq, 0);
+                c->ctl_sent_ms = now;
+            }
+        }
+        break;
+    }
+}
+
+int sham_timeout_ms(const struct sham_conn *c) {
+    long long next = -1;
+#define SOONER(t) do { long long _t = (t); if (next < 0 || _t < next) next = _t; } while (0)
+    switch (c->state) {
+    case SHAM_SYN_SENT:
+    case SHAM_SYN_RCVD:
+        SOONER(c->ctl_sent_ms + RTO_MS);
+        SOONER(c->deadline_ms);
+        break;
+    case SHAM_ESTABLISHED:
+        if (c->synack_pending) SOONER(c->ctl_sent_ms + RTO_MS);
+        // The compressor has no fd to wake us, so poll it while it works
+        if (c->zs && sham_zsend_busy(c->zs)) SOONER(now_ms() + 1);
+        for (int i = 0; i < MAX_SENT_SLOTS; ++i)
+            if (c->slots[i].in_use) SOONER(c->slots[i].sent_time_ms + RTO_MS + 1);
+        if (c->pace_next_us > 0 && snd_queued(c) > 0) SOONER((c->pace_next_us + 999) / 1000);
+        if (c->fin_sent) {
+            if (!c->fin_acked) SOONER(c->ctl_sent_ms + RTO_MS + 1);
+            SOONER(c->deadline_ms);
+        }
+        break;
+    }
+#undef SOONER
+    if (next < 0) return -1;
+    long long d = next - now_ms();
+    return d < 0 ? 0 : (int)d;
+}
+
+// ---------------- public API ----------------
+
+int sham_process(struct sham_conn *c) {
+    struct sham_packet pkt;
+    struct sockaddr_in from;
+    for (;;) {
+        socklen_t from_len = sizeof(from);
+        ssize_t rc = recvfrom(c->sock, &pkt, sizeof(pkt), 0, (struct sockaddr*)&from, &from_len);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (rc < (ssize_t)sizeof(struct sham_header)) continue;
+        handle_packet(c, &pkt, (size_t)rc, &from);
+    }
+    check_timers(c);
+    fill_window(c);
+    return 0;
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+int sham_wait(struct sham_conn *c, struct pollfd *extra, int nextra, int timeout_ms) {
+    struct pollfd fds[1 + SHAM_WAIT_MAX_FDS];
+    if (nextra < 0 || nextra > SHAM_WAIT_MAX_FDS) { errno = EINVAL; return -1; }
+    fds[0].fd = c->sock;
+    fds[0].events = POLLIN;
+    for (int i = 0; i < nextra; ++i) fds[1 + i] = extra[i];
+    int t = sham_timeout_ms(c);
+    if (timeout_ms >= 0 && (t < 0 || timeout_ms < t)) t = timeout_ms;
+
+    int r = 0;
+    if (c->busy_poll_us > 0 && t != 0) {
+        // Spin on non-blocking polls, backing off exponentially between
+        // checks, so an arriving packet is picked up without a wakeup
+        long long start = now_us();
+        long long until = start + c->busy_poll_us;
+        if (t > 0 && start + t * 1000LL < until) until = start + t * 1000LL;
+        unsigned backoff = 1;
+        while ((r = poll(fds, (nfds_t)(1 + nextra), 0)) == 0 && now_us() < until) {
+            for (unsigned i = 0; i < backoff; ++i) cpu_relax();
+            // Once backed off fully, also give the CPU away in case the
+            // peer we wait for shares it
+            if (backoff < SPIN_BACKOFF_MAX) backoff <<= 1;
+            else sched_yield();
+        }
+        if (r == 0 && t > 0) {
+            t -= (int)((now_us() - start) / 1000);
+            if (t < 0) t = 0;
+        }
+    }
+    if (r == 0) r = poll(fds, (nfds_t)(1 + nextra), t);
+    if (r < 0 && errno != EINTR) return -1;
+    sham_process(c);
+
+    int ready = 0;
+    for (int i = 0; i < nextra; ++i) {
+        extra[i].revents = r > 0 ? fds[1 + i].revents : 0;
+        if (extra[i].revents) ready++;
+    }
+    return ready;
+}
+
+// Block until the socket is readable or the next timer fires, then process
+static int wait_event(struct sham_conn *c) {
+    return sham_wait(c, NULL, 0, -1) < 0 ? -1 : 0;
+}
+
+int sham_pin_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set);
+}
+
+struct sham_conn *sham_listen(uint16_t port, const struct sham_opts *opts) {
+    struct sham_conn *c = conn_new(opts);
+    if (!c) return NULL;
+    struct sockaddr_in me; memset(&me, 0, sizeof(me));
+    me.sin_family = AF_INET; me.sin_addr.s_addr = INADDR_ANY; me.sin_port = htons(port);
+    if (bind(c->sock, (struct sockaddr*)&me, sizeof(me)) < 0) {
+        int e = errno; conn_free(c); errno = e;
+        return NULL;
+    }
+    load_fo_key(c, opts ? opts->fastopen_key : NULL);
+    c->state = SHAM_LISTEN;
+    while (!c->nonblock && c->state != SHAM_ESTABLISHED) {
+        if (wait_event(c) < 0) { int e = errno; conn_free(c); errno = e; return NULL; }
+    }
+    return c;
+}
+
+struct sham_conn *sham_connect(const char *ip, uint16_t port, const struct sham_opts *opts) {
+    return sham_connect_data(ip, port, opts, NULL, 0, 0);
+}
+
+struct sham_conn *sham_connect_data(const char *ip, uint16_t port, const struct sham_opts *opts,
+                                    const void *data, size_t len, int fin) {
+    if (len > SND_BUF_BYTES - 2 * SHAM_ZHDR) { errno = EMSGSIZE; return NULL; }
+    struct sham_conn *c = conn_new(opts);
+    if (!c) return NULL;
+    c->peer.sin_family = AF_INET;
+    c->peer.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &c->peer.sin_addr) != 1) {
+        conn_free(c); errno = EINVAL;
+        return NULL;
+    }
+    c->have_peer = true;
+
+    c->isn = random_isn();
+    c->snd_una = c->snd_nxt = c->isn + 1;
+    if (c->fastopen) cookie_load(c);
+
+    if (c->zs) {
+        // Compress inline: the first block may have to ride in the SYN
+        char out[SHAM_ZHDR + SHAM_ZBLOCK];
+        for (size_t off = 0; off < len; off += SHAM_ZBLOCK) {
+            size_t n = len - off < SHAM_ZBLOCK ? len - off : SHAM_ZBLOCK;
+            ring_write(&c->sndq, out, sham_zencode((const char *)data + off, n, out, &c->zsyn));
+        }
+    } else {
+        ring_write(&c->sndq, data, len);
+    }
+
+    if (c->fastopen && c->have_cookie && c->sndq.len > 0) {
+        // The first segment rides in the SYN; it lives in a slot like any
+        // other so it is resent as plain data if the server rejects it
+        size_t room = seg_room(c) - SHAM_COOKIE_LEN;
+        size_t syn_n = c->sndq.len < room ? c->sndq.len : room;
+        struct sent_slot *s = &c->slots[0];
+        syn_n = make_segment(c, s, 0, syn_n);
+        s->in_use = 1;
+        s->sent_time_ms = now_ms();
+        s->sent_us = now_us();
+        c->syn_slot = 0;
+        c->inflight = 1;
+        c->snd_nxt += (uint32_t)syn_n;
+        c->stats.segs_sent++;
+        c->stats.bytes_sent += syn_n;
+    }
+    if (fin) {
+        c->close_requested = true;
+        if (c->syn_slot >= 0 && c->sndq.len == 0) {
+            c->fin_sent = true;
+            c->fin_seq = c->snd_nxt;
+            c->active_close = true;
+        }
+    }
+
+    send_syn(c);
+    c->state = SHAM_SYN_SENT;
+    c->ctl_sent_ms = now_ms();
+    c->ctl_sent_us = now_us();
+    c->deadline_ms = c->ctl_sent_ms + HANDSHAKE_TIMEOUT_MS;
+
+    while (!c->nonblock && c->state == SHAM_SYN_SENT) {
+        if (wait_event(c) < 0) break;
+    }
+    if (c->state == SHAM_CLOSED) {
+        conn_free(c); errno = ETIMEDOUT;
+        return NULL;
+    }
+    return c;
+}
+
+ssize_t sham_send(struct sham_conn *c, const void *buf, size_t len) {
+    return sham_send_stream(c, 0, buf, len);
+}
+
+ssize_t sham_send_stream(struct sham_conn *c, int stream, const void *buf, size_t len) {
+    if (stream < 0 || stream >= SHAM_MAX_STREAMS || (stream > 0 && !c->streams_on)) {
+        errno = EINVAL;
+        return -1;
+    }
+    struct sham_ring *q = stream_sq(c, stream);
+    if (!q) return -1;
+    size_t done = 0;
+    for (;;) {
+        if (c->close_requested || c->state == SHAM_CLOSED) {
+            if (done > 0) return (ssize_t)done;
+            errno = c->error ? c->error : EPIPE;
+            return -1;
+        }
+        if (c->zs && stream == 0) done += sham_zsend_write(c->zs, (const char *)buf + done, len - done);
+        else done += ring_write(q, (const char *)buf + done, len - done);
+        fill_window(c);
+        if (done == len) return (ssize_t)done;
+        if (c->nonblock) {
+            if (done > 0) return (ssize_t)done;
+            errno = EAGAIN;
+            return -1;
+        }
+        if (wait_event(c) < 0) return done > 0 ? (ssize_t)done : -1;
+    }
+}
+
+// Peek n bytes at the head of a ring without consuming them
+static void ring_peek(const struct sham_ring *r, void *dst, size_t n) {
+    size_t first = n < r->cap - r->head ? n : r->cap - r->head;
+    memcpy(dst, r->buf + r->head, first);
+    memcpy((char *)dst + first, r->buf, n - first);
+}
+
+// Decode the next complete block from rcvq into zraw. Returns 1 if a block
+// was decoded, 0 if more bytes are needed, -1 on a corrupt stream.
+static int decode_block(struct sham_conn *c) {
+    char hdr[SHAM_ZHDR];
+    uint32_t raw_len, enc_len;
+    int stored;
+    if (c->rcvq.len < SHAM_ZHDR) return 0;
+    ring_peek(&c->rcvq, hdr, SHAM_ZHDR);
+    if (sham_zheader(hdr, &raw_len, &enc_len, &stored) < 0) return -1;
+    if (c->rcvq.len < SHAM_ZHDR + enc_len) return 0;
+
+    char enc[SHAM_ZBLOCK];
+    if (!c->zraw && !(c->zraw = malloc(SHAM_ZBLOCK))) return -1;
+    ring_read(&c->rcvq, hdr, SHAM_ZHDR);
+    ring_read(&c->rcvq, enc, enc_len);
+    if (sham_zdecode(enc, enc_len, stored, c->zraw, raw_len) < 0) return -1;
+    c->zraw_len = raw_len;
+    c->zraw_off = 0;
+    return 1;
+}
+
+ssize_t sham_recv(struct sham_conn *c, void *buf, size_t len) {
+    for (;;) {
+        if (c->peer_compress && c->zraw_off == c->zraw_len) {
+            int d = decode_block(c);
+            if (d < 0) { sham_log("CORRUPT COMPRESSED STREAM"); errno = EBADMSG; return -1; }
+            if (d > 0 && c->adv_wnd < SHAM_PAYLOAD && rcv_window(c) >= SHAM_PAYLOAD) send_ack(c);
+        }
+        if (c->peer_compress && c->zraw_off < c->zraw_len) {
+            size_t n = c->zraw_len - c->zraw_off < len ? c->zraw_len - c->zraw_off : len;
+            memcpy(buf, c->zraw + c->zraw_off, n);
+            c->zraw_off += (uint32_t)n;
+            c->stats.bytes_delivered += n;
+            return (ssize_t)n;
+        }
+        if (!c->peer_compress && c->rcvq.len > 0) {
+            size_t n = ring_read(&c->rcvq, buf, len);
+            c->stats.bytes_delivered += n;
+            if (c->peer_streams) rx_drain(c);
+            // Reopen a window we had (nearly) closed so the sender resumes
+            if (c->adv_wnd < SHAM_PAYLOAD && rcv_window(c) >= SHAM_PAYLOAD) send_ack(c);
+            return (ssize_t)n;
+        }
+        if (c->peer_fin || c->state == SHAM_CLOSED) {
+            if (c->error) { errno = c->error; return -1; }
+            return 0;
+        }
+        if (c->nonblock) { errno = EAGAIN; return -1; }
+        if (wait_event(c) < 0) return -1;
+    }
+}
+
+ssize_t sham_recv_stream(struct sham_conn *c, int stream, void *buf, size_t len) {
+    if (stream == 0) return sham_recv(c, buf, len);
+    if (stream < 0 || stream >= SHAM_MAX_STREAMS) { errno = EINVAL; return -1; }
+    struct sham_ring *q = &c->streams[stream].rq;
+    for (;;) {
+        if (q->len > 0) {
+            size_t n = ring_read(q, buf, len);
+            c->stats.bytes_delivered += n;
+            rx_drain(c);
+            if (c->adv_wnd < SHAM_PAYLOAD && rcv_window(c) >= SHAM_PAYLOAD) send_ack(c);
+            return (ssize_t)n;
+        }
+        if (c->peer_fin || c->state == SHAM_CLOSED) {
+            if (c->error) { errno = c->error; return -1; }
+            return 0;
+        }
+        if (c->nonblock) { errno = EAGAIN; return -1; }
+        if (wait_event(c) < 0) return -1;
+    }
+}
+
+int sham_set_priority(struct sham_conn *c, int stream, int priority, int weight) {
+    if (stream < 0 || stream >= SHAM_MAX_STREAMS || priority < 0 || weight < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    c->streams[stream].priority = priority;
+    c->streams[stream].weight = weight;
+    return 0;
+}
+
+int sham_shutdown(struct sham_conn *c) {
+    if (c->state == SHAM_ESTABLISHED && !c->close_requested) {
+        c->close_requested = true;
+        fill_window(c);
+    }
+    while (c->state == SHAM_ESTABLISHED && !c->fin_acked) {
+        if (c->nonblock) {
+            sham_process(c);
+            if (c->state == SHAM_ESTABLISHED && !c->fin_acked) {
+                errno = EAGAIN;
+                return -1;
+            }
+            break;
+        }
+        if (wait_event(c) < 0) return -1;
+    }
+    if (!c->fin_acked) { errno = c->error ? c->error : ETIMEDOUT; return -1; }
+    return 0;
+}
+
+int sham_close(struct sham_conn *c) {
+    if (c->state == SHAM_ESTABLISHED && !c->close_requested) {
+        c->close_requested = true;
+        fill_window(c);
+    }
+    while (c->state == SHAM_ESTABLISHED) {
+        if (c->nonblock) {
+            sham_process(c);
+            if (c->state == SHAM_ESTABLISHED) {
+                errno = EAGAIN;
+                return -1;
+            }
+            break;
+        }
+        if (wait_event(c) < 0) break;
+    }
+    conn_free(c);
+    return 0;
+}
+
+int sham_get_stats(const struct sham_conn *c, struct sham_stats *st) {
+    *st = c->stats;
+    struct sham_zstats z = c->zsyn;
+    if (c->zs) {
+        struct sham_zstats w;
+        sham_zsend_stats(c->zs, &w);
+        z.raw_bytes += w.raw_bytes; z.enc_bytes += w.enc_bytes;
+        z.blocks += w.blocks; z.bypassed += w.bypassed;
+    }
+    st->zraw_bytes = z.raw_bytes;
+    st->zenc_bytes = z.enc_bytes;
+    st->zblocks = z.blocks;
+    st->zbypassed = z.bypassed;
+    st->srtt_us = (uint32_t)c->srtt_us;
+    st->fec_k = (uint32_t)c->fec_k;
+    st->fec_peer_rebuilt = c->peer_rebuilt;
+    st->segs_lost = c->fec_holes + c->peer_rebuilt;
+    st->pacing_rate = c->pacing == SHAM_PACE_OFF ? 0 : (uint64_t)c->pacing_rate;
+    if (c->established_ms) st->elapsed_ms = (c->done_ms ? c->done_ms : now_ms()) - c->established_ms;
+    return 0;
+}
+
+int sham_fd(const struct sham_conn *c) { return c->sock; }
+int sham_state(const struct sham_conn *c) { return c->state; }
+void sham_set_nonblock(struct sham_conn *c, int on) { c->nonblock = on; }
+void sham_set_cork(struct sham_conn *c, int on) {
+    c->cork = on;
+    if (on) return;
+    if (c->zs) sham_zsend_flush(c->zs);
+    fill_window(c);
+}
+//#llm generated code ends
@@ -3,6 +3,8 @@
 #define SHAM_H
 
 #include <stdint.h>
+#include <sys/types.h>
+#include <poll.h>
 
 #define SHAM_PAYLOAD 1024
 
@@ -10,6 +12,19 @@
 #define SHAM_SYN 0x1
 #define SHAM_ACK 0x2
 #define SHAM_FIN 0x4
+#define SHAM_COOKIE 0x8   // fast open: SYN requests/carries a cookie, SYN-ACK returns one
+#define SHAM_COMPRESS 0x10 // on SYN / SYN-ACK: the sender's stream is sent as compressed blocks
+// On SYN / SYN-ACK: the sender's stream carries parity. Otherwise marks a
+// parity segment: seq = first byte of the block, ack = k << 16 | XOR of the
+// k segment lengths, window = block length in bytes, payload = XOR of the
+// k segments. ACKs for such a stream carry in seq the number of segments the
+// receiver has rebuilt so far.
+#define SHAM_FEC 0x20
+// On SYN / SYN-ACK: every data segment from the sender starts with a
+// struct sham_stream_hdr; also set on those data segments
+#define SHAM_STREAM 0x40
+
+#define SHAM_COOKIE_LEN 8
 
 #pragma pack(push,1)
 struct sham_header {
@@ -19,6 +34,15 @@ struct sham_header {
     uint16_t window_size;  // flow control window (bytes)
 };
 
+// Leads the payload of a data segment when SHAM_STREAM is in use. The
+// connection's seq/ack cover it like payload; offset counts the stream's
+// own bytes so each stream is reassembled independently of the others.
+struct sham_stream_hdr {
+    uint16_t stream_id;
+    uint16_t reserved;
+    uint32_t offset;       // stream offset of the first data byte, wraps at 2^32
+};
+
 // full packet = header + payload
 struct sham_packet {
     struct sham_header hdr;
@@ -26,5 +50,134 @@ struct sham_packet {
 };
 #pragma pack(pop)
 
+// ---------------- libsham: socket-like connection API ----------------
+
+// Connection states, as reported by sham_state()
+enum sham_state {
+    SHAM_CLOSED = 0,
+    SHAM_LISTEN,
+    SHAM_SYN_SENT,
+    SHAM_SYN_RCVD,
+    SHAM_ESTABLISHED,
+    SHAM_TIME_WAIT         // not entered any more: the passive closer waits instead
+};
+
+// Sender pacing modes
+enum sham_pacing {
+    SHAM_PACE_OFF = 0,     // release the whole window back-to-back
+    SHAM_PACE_USER,        // token bucket at window/RTT (default)
+    SHAM_PACE_KERNEL       // SO_MAX_PACING_RATE (fq qdisc), user space if unsupported
+};
+
+struct sham_opts {
+    int nonblock;          // calls return -1/EAGAIN instead of waiting
+    double loss_rate;      // probability of dropping an incoming data packet (testing)
+    int pacing;            // enum sham_pacing
+    int fastopen;          // client: carry data in the SYN using a cached server cookie
+    const char *fastopen_cache;  // client: cookie cache file (NULL = cookies not kept)
+    const char *fastopen_key;    // server: cookie secret file, created if missing (NULL = per process)
+    int compress;          // compress our outgoing stream (zlib blocks on a worker thread)
+    int fec;               // parity: 0 = off, k = one per k data segments (1..10), SHAM_FEC_AUTO
+    int busy_poll;         // microseconds to spin on the socket before sleeping (SO_BUSY_POLL), 0 = off
+    int streams;           // send stream headers so streams 1..SHAM_MAX_STREAMS-1 can be used
+};
+
+#define SHAM_MAX_STREAMS 8
+
+#define SHAM_BUSY_POLL_US 100  // busy_poll budget the front ends use for a bare --busy-poll
+
+#define SHAM_FEC_AUTO (-1)  // choose k from the observed loss rate
+
+struct sham_stats {
+    uint64_t bytes_sent;       // payload bytes sent (first transmissions)
+    uint64_t bytes_acked;      // payload bytes acknowledged by the peer
+    uint64_t bytes_received;   // in-order payload bytes from the peer
+    uint64_t bytes_delivered;  // bytes handed to sham_recv() (after decompression)
+    uint64_t segs_sent;        // data segments, first transmissions
+    uint64_t segs_retx;        // data segments retransmitted on timeout
+    uint64_t segs_lost;        // holes: timeouts at the oldest unacked segment, plus segments the peer rebuilt
+    uint32_t srtt_us;          // smoothed round-trip time
+    uint64_t pacing_rate;      // bytes/s, 0 when not pacing
+    long long elapsed_ms;      // since establishment, frozen once our FIN is acked
+    uint64_t zraw_bytes;       // compression: app bytes in
+    uint64_t zenc_bytes;       // compression: bytes out, block headers included
+    uint64_t zblocks;
+    uint64_t zbypassed;        // blocks sent stored because they did not shrink
+    uint64_t fec_parity;       // parity segments sent
+    uint32_t fec_k;            // data segments per parity segment now, 0 = none
+    uint64_t fec_rebuilt;      // segments we rebuilt from the peer's parity
+    uint64_t fec_peer_rebuilt; // segments the peer rebuilt from our parity
+};
+
+struct sham_conn;
+
+void sham_opts_init(struct sham_opts *opts);
+
+// Server side: bind to port and accept a single peer. In blocking mode this
+// returns once the handshake is complete; in nonblocking mode it returns at
+// once in SHAM_LISTEN and the handshake progresses inside sham_process().
+struct sham_conn *sham_listen(uint16_t port, const struct sham_opts *opts);
+// Client side: send a SYN to ip:port. Blocking mode waits for the handshake
+// (NULL with errno = ETIMEDOUT if it fails); nonblocking returns in SHAM_SYN_SENT.
+struct sham_conn *sham_connect(const char *ip, uint16_t port, const struct sham_opts *opts);
+// sham_connect() that queues len bytes (at most 64 KB) before the SYN goes out.
+// With opts->fastopen and a cached cookie the first segment rides in the SYN
+// so the server can consume it one RTT after connect; without a cookie the
+// SYN asks for one. fin = no more data will follow (FIN rides along if it fits).
+struct sham_conn *sham_connect_data(const char *ip, uint16_t port, const struct sham_opts *opts,
+                                    const void *data, size_t len, int fin);
+
+// Queue bytes for reliable, ordered delivery. Returns the number of bytes
+// accepted, or -1 with errno = EAGAIN (nonblocking, buffer full) or EPIPE.
+ssize_t sham_send(struct sham_conn *c, const void *buf, size_t len);
+// Read in-order bytes. Returns 0 once the peer has closed and everything has
+// been read, -1 with errno = EAGAIN when nothing is available (nonblocking).
+ssize_t sham_recv(struct sham_conn *c, void *buf, size_t len);
+
+// Streams: independent ordered byte streams sharing the connection's window.
+// sham_send()/sham_recv() are stream 0; other streams need opts->streams on
+// the sending side (the receiver learns it from the handshake). A loss only
+// delays the stream it belongs to. Compression applies to stream 0 only.
+ssize_t sham_send_stream(struct sham_conn *c, int stream, const void *buf, size_t len);
+ssize_t sham_recv_stream(struct sham_conn *c, int stream, void *buf, size_t len);
+// Scheduling of our streams: higher priority is always served first (default
+// 0); streams of equal priority share by weight (default 1, deficit round
+// robin). Streams with priority > 0 skip pacing and may exceed the packet
+// window by a couple of segments, so short control messages are not queued
+// behind a bulk transfer.
+int sham_set_priority(struct sham_conn *c, int stream, int priority, int weight);
+// Flush queued data, exchange FINs and free the connection. In nonblocking
+// mode returns -1/EAGAIN until the exchange is done; call it again after
+// sham_process(). Returns 0 once the connection has been freed.
+int sham_close(struct sham_conn *c);
+// Half-close: flush queued data and send our FIN, then (blocking mode) wait
+// until the peer has acknowledged everything. sham_recv() keeps working.
+int sham_shutdown(struct sham_conn *c);
+int sham_get_stats(const struct sham_conn *c, struct sham_stats *st);
+
+// Event loop integration: poll sham_fd() for POLLIN with a timeout of
+// sham_timeout_ms() (-1 = no timer pending), then call sham_process().
+int sham_fd(const struct sham_conn *c);
+int sham_timeout_ms(const struct sham_conn *c);
+int sham_process(struct sham_conn *c);
+int sham_state(const struct sham_conn *c);
+void sham_set_nonblock(struct sham_conn *c, int on);
+// Wait until a packet arrives or a timer is due (then process it), until one
+// of the nextra (at most SHAM_WAIT_MAX_FDS) extra fds is ready, or timeout_ms
+// passes (-1 = no limit). With opts->busy_poll the sockets are spun on first.
+// Returns the number of extra fds with revents set, or -1.
+#define SHAM_WAIT_MAX_FDS 8
+int sham_wait(struct sham_conn *c, struct pollfd *extra, int nextra, int timeout_ms);
+// Pin the calling thread, e.g. an I/O loop, to one CPU
+int sham_pin_cpu(int cpu);
+// While corked only full segments are sent, so many small writes share
+// segments; uncorking or closing flushes the remainder
+void sham_set_cork(struct sham_conn *c, int on);
+
+// Protocol event log, enabled with RUDP_LOG=1
+void sham_log_open(const char *name);
+void sham_log_close(void);
+void sham_log(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
 #endif // SHAM_H
-//#llm generated code ends
\ No newline at end of file
+//#llm generated code ends
@@ -0,0 +1,58 @@
+// sham_chat.c
+// #llm generated code begins
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include "sham_chat.h"
+
+// Print every complete line received so far, keeping a partial tail
+static size_t print_lines(const char *who, char *pending, size_t len) {
+    size_t start = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (pending[i] == '\n') {
+            printf("%s: %.*s\n", who, (int)(i - start), pending + start);
+            start = i + 1;
+        }
+    }
+    memmove(pending, pending + start, len - start);
+    return len - start;
+}
+
+void sham_chat(struct sham_conn *conn, const char *peer) {
+    sham_set_nonblock(conn, 1);
+
+    // Buffers are set up once; with busy polling sham_wait() spins on stdin
+    // and the socket instead of sleeping
+    char buf[2048];
+    char pending[4096];
+    size_t pending_len = 0;
+    struct pollfd in = { .fd = STDIN_FILENO, .events = POLLIN };
+
+    while (1) {
+        int ready = sham_wait(conn, &in, 1, 1000);
+        if (ready < 0) break;
+        if (ready > 0) {
+            if (!fgets(buf, sizeof(buf) - 1, stdin)) break;
+            buf[strcspn(buf, "\n")] = 0;
+            if (strcmp(buf, "/quit") == 0) break;   // we end the chat
+            size_t ml = strlen(buf);
+            buf[ml++] = '\n';
+            if (sham_send(conn, buf, ml) < 0) perror("sham_send");
+        }
+
+        ssize_t n;
+        while ((n = sham_recv(conn, pending + pending_len, sizeof(pending) - pending_len)) > 0) {
+            pending_len = print_lines(peer, pending, pending_len + (size_t)n);
+            if (pending_len == sizeof(pending)) pending_len = 0;   // overlong line, drop it
+        }
+        fflush(stdout);
+        if (n == 0) break;   // the peer ended it
+    }
+    sham_set_nonblock(conn, 0);
+    sham_close(conn);
+}
+//#llm generated code ends
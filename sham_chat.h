@@ -0,0 +1,14 @@
+//#llm generated code begins
+#ifndef SHAM_CHAT_H
+#define SHAM_CHAT_H
+
+// Shared by the client and server front ends: the interactive chat loop.
+
+#include "sham.h"
+
+// Send stdin lines to the peer and print its lines as "<peer>: text" until
+// either side types /quit or closes; then close the connection.
+void sham_chat(struct sham_conn *conn, const char *peer);
+
+#endif // SHAM_CHAT_H
+//#llm generated code ends
@@ -0,0 +1,211 @@
+// sham_compress.c
+// #llm generated code begins
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <zlib.h>
+
+#include "sham_compress.h"
+
+#define ZSEND_BLOCKS 4             // one being filled, the rest queued/compressing/draining
+#define ZPROBE 4096                // sample compressed first to skip incompressible blocks
+
+enum { ZB_FILLING = 0, ZB_QUEUED, ZB_DONE };
+
+struct zblock {
+    int state;
+    size_t raw_len;
+    size_t out_len, out_off;
+    char raw[SHAM_ZBLOCK];
+    char out[SHAM_ZHDR + SHAM_ZBLOCK];
+};
+
+struct sham_zsend {
+    pthread_t thread;
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+    bool stop;
+    struct zblock blk[ZSEND_BLOCKS];
+    unsigned fill, work, drain;    // block index the app fills / worker encodes / sender drains
+    struct sham_zstats st;
+};
+
+size_t sham_zencode(const char *raw, size_t n, char *out, struct sham_zstats *st) {
+    uint32_t hdr[2];
+    uLongf dlen = 0;
+    bool compressed = false;
+
+    // Probe a prefix first: a block whose start does not shrink is almost
+    // always incompressible (media, archives), so skip the full attempt
+    bool worth = true;
+    if (n >= 2 * ZPROBE) {
+        char probe[ZPROBE];
+        uLongf plen = sizeof(probe) - sizeof(probe) / 16;
+        worth = compress2((Bytef *)probe, &plen, (const Bytef *)raw, ZPROBE, Z_BEST_SPEED) == Z_OK;
+    }
+    if (worth && n > 1) {
+        // Only accept output that is strictly smaller than the input
+        dlen = n - 1;
+        compressed = compress2((Bytef *)out + SHAM_ZHDR, &dlen, (const Bytef *)raw, n, Z_BEST_SPEED) == Z_OK;
+    }
+    if (!compressed) {
+        memcpy(out + SHAM_ZHDR, raw, n);
+        dlen = n;
+    }
+    hdr[0] = htonl((uint32_t)n);
+    hdr[1] = htonl((uint32_t)dlen | (compressed ? 0 : SHAM_ZSTORED));
+    memcpy(out, hdr, sizeof(hdr));
+
+    if (st) {
+        st->raw_bytes += n;
+        st->enc_bytes += SHAM_ZHDR + dlen;
+        st->blocks++;
+        if (!compressed) st->bypassed++;
+    }
+    return SHAM_ZHDR + dlen;
+}
+
+int sham_zheader(const char *hdr, uint32_t *raw_len, uint32_t *enc_len, int *stored) {
+    uint32_t h[2];
+    memcpy(h, hdr, sizeof(h));
+    *raw_len = ntohl(h[0]);
+    *enc_len = ntohl(h[1]) & ~SHAM_ZSTORED;
+    *stored = (ntohl(h[1]) & SHAM_ZSTORED) != 0;
+    if (*raw_len > SHAM_ZBLOCK || *enc_len > SHAM_ZBLOCK) return -1;
+    if (*stored && *enc_len != *raw_len) return -1;
+    return 0;
+}
+
+int sham_zdecode(const char *enc, uint32_t enc_len, int stored, char *raw, uint32_t raw_len) {
+    if (stored) {
+        memcpy(raw, enc, raw_len);
+        return 0;
+    }
+    uLongf rl = raw_len;
+    if (uncompress((Bytef *)raw, &rl, (const Bytef *)enc, enc_len) != Z_OK || rl != raw_len) return -1;
+    return 0;
+}
+
+// ---------------- sender worker ----------------
+
+static void *zsend_worker(void *arg) {
+    struct sham_zsend *z = arg;
+    pthread_mutex_lock(&z->mu);
+    for (;;) {
+        while (!z->stop && z->blk[z->work].state != ZB_QUEUED) pthread_cond_wait(&z->cv, &z->mu);
+        if (z->stop) break;
+        struct zblock *b = &z->blk[z->work];
+        struct sham_zstats local = {0};
+        pthread_mutex_unlock(&z->mu);
+
+        b->out_len = sham_zencode(b->raw, b->raw_len, b->out, &local);
+        b->out_off = 0;
+
+        pthread_mutex_lock(&z->mu);
+        z->st.raw_bytes += local.raw_bytes;
+        z->st.enc_bytes += local.enc_bytes;
+        z->st.blocks += local.blocks;
+        z->st.bypassed += local.bypassed;
+        b->state = ZB_DONE;
+        z->work = (z->work + 1) % ZSEND_BLOCKS;
+    }
+    pthread_mutex_unlock(&z->mu);
+    return NULL;
+}
+
+struct sham_zsend *sham_zsend_new(void) {
+    struct sham_zsend *z = calloc(1, sizeof(*z));
+    if (!z) return NULL;
+    pthread_mutex_init(&z->mu, NULL);
+    pthread_cond_init(&z->cv, NULL);
+    if (pthread_create(&z->thread, NULL, zsend_worker, z) != 0) {
+        pthread_mutex_destroy(&z->mu);
+        pthread_cond_destroy(&z->cv);
+        free(z);
+        return NULL;
+    }
+    return z;
+}
+
+void sham_zsend_free(struct sham_zsend *z) {
+    if (!z) return;
+    pthread_mutex_lock(&z->mu);
+    z->stop = true;
+    pthread_cond_signal(&z->cv);
+    pthread_mutex_unlock(&z->mu);
+    pthread_join(z->thread, NULL);
+    pthread_mutex_destroy(&z->mu);
+    pthread_cond_destroy(&z->cv);
+    free(z);
+}
+
+// Caller holds z->mu
+static void queue_fill_block(struct sham_zsend *z) {
+    z->blk[z->fill].state = ZB_QUEUED;
+    z->fill = (z->fill + 1) % ZSEND_BLOCKS;
+    pthread_cond_signal(&z->cv);
+}
+
+size_t sham_zsend_write(struct sham_zsend *z, const void *buf, size_t len) {
+    size_t done = 0;
+    pthread_mutex_lock(&z->mu);
+    while (done < len) {
+        struct zblock *b = &z->blk[z->fill];
+        if (b->state != ZB_FILLING) break;   // all blocks busy: back-pressure
+        size_t n = SHAM_ZBLOCK - b->raw_len;
+        if (n > len - done) n = len - done;
+        memcpy(b->raw + b->raw_len, (const char *)buf + done, n);
+        b->raw_len += n;
+        done += n;
+        if (b->raw_len == SHAM_ZBLOCK) queue_fill_block(z);
+    }
+    pthread_mutex_unlock(&z->mu);
+    return done;
+}
+
+void sham_zsend_flush(struct sham_zsend *z) {
+    pthread_mutex_lock(&z->mu);
+    struct zblock *b = &z->blk[z->fill];
+    if (b->state == ZB_FILLING && b->raw_len > 0) queue_fill_block(z);
+    pthread_mutex_unlock(&z->mu);
+}
+
+size_t sham_zsend_read(struct sham_zsend *z, void *dst, size_t n) {
+    size_t done = 0;
+    pthread_mutex_lock(&z->mu);
+    while (done < n && z->blk[z->drain].state == ZB_DONE) {
+        struct zblock *b = &z->blk[z->drain];
+        size_t k = b->out_len - b->out_off;
+        if (k > n - done) k = n - done;
+        memcpy((char *)dst + done, b->out + b->out_off, k);
+        b->out_off += k;
+        done += k;
+        if (b->out_off == b->out_len) {
+            b->state = ZB_FILLING;
+            b->raw_len = 0;
+            z->drain = (z->drain + 1) % ZSEND_BLOCKS;
+        }
+    }
+    pthread_mutex_unlock(&z->mu);
+    return done;
+}
+
+int sham_zsend_busy(struct sham_zsend *z) {
+    pthread_mutex_lock(&z->mu);
+    // A block still being filled is not work until it is flushed or full
+    int busy = 0;
+    for (int i = 0; i < ZSEND_BLOCKS; ++i) if (z->blk[i].state != ZB_FILLING) busy = 1;
+    pthread_mutex_unlock(&z->mu);
+    return busy;
+}
+
+void sham_zsend_stats(struct sham_zsend *z, struct sham_zstats *st) {
+    pthread_mutex_lock(&z->mu);
+    *st = z->st;
+    pthread_mutex_unlock(&z->mu);
+}
+//#llm generated code ends
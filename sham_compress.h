@@ -0,0 +1,43 @@
+//#llm generated code begins
+#ifndef SHAM_COMPRESS_H
+#define SHAM_COMPRESS_H
+
+// Internal to libsham: block compression of an outgoing byte stream.
+// Each block is framed as an 8-byte header (raw length, encoded length with
+// SHAM_ZSTORED set when the block is sent uncompressed) followed by the payload.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHAM_ZBLOCK 32768          // raw bytes per block
+#define SHAM_ZHDR 8
+#define SHAM_ZSTORED 0x80000000u
+
+struct sham_zstats {
+    uint64_t raw_bytes;            // app bytes compressed
+    uint64_t enc_bytes;            // bytes produced, headers included
+    uint64_t blocks;
+    uint64_t bypassed;             // blocks sent stored because they did not shrink
+};
+
+// Sender: app bytes go in with write(), a worker thread compresses full
+// blocks, framed output comes back out with read() in order.
+struct sham_zsend;
+struct sham_zsend *sham_zsend_new(void);
+void sham_zsend_free(struct sham_zsend *z);
+size_t sham_zsend_write(struct sham_zsend *z, const void *buf, size_t len);
+void sham_zsend_flush(struct sham_zsend *z);
+size_t sham_zsend_read(struct sham_zsend *z, void *dst, size_t n);
+int sham_zsend_busy(struct sham_zsend *z);
+void sham_zsend_stats(struct sham_zsend *z, struct sham_zstats *st);
+
+// Encode one block (n <= SHAM_ZBLOCK) into out, which must hold
+// SHAM_ZHDR + SHAM_ZBLOCK bytes. Returns the framed length.
+size_t sham_zencode(const char *raw, size_t n, char *out, struct sham_zstats *st);
+// Parse a block header; -1 if it is malformed
+int sham_zheader(const char *hdr, uint32_t *raw_len, uint32_t *enc_len, int *stored);
+// Decode a block payload into raw (raw_len bytes); -1 on corrupt data
+int sham_zdecode(const char *enc, uint32_t enc_len, int stored, char *raw, uint32_t raw_len);
+
+#endif // SHAM_COMPRESS_H
+//#llm generated code ends
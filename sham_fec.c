@@ -0,0 +1,46 @@
+// sham_fec.c
+// #llm generated code begins
+#include <stdint.h>
+#include <string.h>
+
+#include "sham_fec.h"
+
+#define FEC_MIN_LOSS 0.005         // below this parity costs more than the RTOs it saves
+
+typedef uint8_t fec_vec __attribute__((vector_size(32)));
+
+// The vector type lowers to two SSE2 ops per step on baseline x86-64; the
+// AVX2 clone does it in one and is picked at load time when available.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+__attribute__((target_clones("avx2", "default")))
+#endif
+void sham_fec_xor(void *dst, const void *src, size_t n) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    size_t i = 0;
+    for (; i + 4 * sizeof(fec_vec) <= n; i += 4 * sizeof(fec_vec)) {
+        fec_vec a[4], b[4];
+        memcpy(a, d + i, sizeof(a));
+        memcpy(b, s + i, sizeof(b));
+        for (int j = 0; j < 4; ++j) a[j] ^= b[j];
+        memcpy(d + i, a, sizeof(a));
+    }
+    for (; i + sizeof(fec_vec) <= n; i += sizeof(fec_vec)) {
+        fec_vec a, b;
+        memcpy(&a, d + i, sizeof(a));
+        memcpy(&b, s + i, sizeof(b));
+        a ^= b;
+        memcpy(d + i, &a, sizeof(a));
+    }
+    for (; i < n; ++i) d[i] ^= s[i];
+}
+
+// One parity per 1/(2p) segments keeps roughly one expected loss per two
+// blocks, the point past which single parity stops rebuilding most holes.
+int sham_fec_pick_k(double loss, int max_k) {
+    if (loss < FEC_MIN_LOSS) return 0;
+    double k = 1.0 / (2.0 * loss);
+    if (k >= max_k) return max_k;
+    return k < 1.0 ? 1 : (int)k;
+}
+//#llm generated code ends
@@ -0,0 +1,18 @@
+//#llm generated code begins
+#ifndef SHAM_FEC_H
+#define SHAM_FEC_H
+
+// Internal to libsham: XOR parity for forward error correction. One parity
+// segment covers a block of k consecutive data segments and rebuilds any
+// single one of them.
+
+#include <stddef.h>
+
+// dst ^= src over n bytes (vectorized, AVX2 when the CPU has it)
+void sham_fec_xor(void *dst, const void *src, size_t n);
+// Data segments per parity segment for an estimated loss probability,
+// between 1 and max_k; 0 when loss is too low to be worth parity
+int sham_fec_pick_k(double loss, int max_k);
+
+#endif // SHAM_FEC_H
+//#llm generated code ends
@@ -0,0 +1,27 @@
+//#llm generated code begins
+#ifndef SHAM_FILE_H
+#define SHAM_FILE_H
+
+// File transfer framing used by client and server over a libsham stream.
+// Client -> server: one record per file, header + name + size bytes of data;
+// the client's FIN ends the transfer.
+// Server -> client: one result line per file, "OK <md5> <name>\n" or "ERR - <name>\n".
+
+#include <stdint.h>
+
+#define SHAM_FILE_MAGIC 0x53484631u   // "SHF1"
+#define SHAM_FILE_BATCH 0x1           // record is part of a multi-file transfer
+#define SHAM_FILE_NAME_MAX 1023
+
+#pragma pack(push,1)
+struct sham_file_hdr {
+    uint32_t magic;
+    uint16_t name_len;
+    uint16_t flags;
+    uint32_t size_hi;      // 64-bit file size, high and low words in network order
+    uint32_t size_lo;
+};
+#pragma pack(pop)
+
+#endif // SHAM_FILE_H
+//#llm generated code ends
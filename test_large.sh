@@ -0,0 +1,66 @@
+#!/bin/bash
+# test_large.sh - transfer a file larger than 4 GB over loopback and check it
+#
+# Usage: ./test_large.sh [size] [port]     (run by `make test-large`)
+#   size      file size for truncate(1), default 4500M (must exceed 4 GiB)
+#   port      UDP port, default 5600
+#   MIN_MBPS  fail if the goodput is below this (default 0 = report only)
+#
+# Uses the client_test/server_test builds (SHAM_TEST), where the SHAM_ISN
+# variable pins the client's ISN just below 2^32, so the sequence number
+# wraps within the first kilobytes and again after every 4 GiB. A short
+# logged transfer first checks that the wrap really happened.
+
+set -u
+SIZE=${1:-4500M}
+PORT=${2:-5600}
+MIN_MBPS=${MIN_MBPS:-0}
+ISN=4294966000
+BIN=$(cd "$(dirname "$0")" && pwd)
+SP=
+DIR=$(mktemp -d "${TMPDIR:-/tmp}/sham_large.XXXXXX")
+trap '[ -n "$SP" ] && kill $SP 2>/dev/null; rm -rf "$DIR"' EXIT
+cd "$DIR" || exit 1
+
+fail() { echo "FAIL: $*"; exit 1; }
+[ -x "$BIN/client_test" ] && [ -x "$BIN/server_test" ] || fail "build client_test and server_test first (make test-large)"
+
+# transfer <input> <output>: one server/client run, client output in client.out
+transfer() {
+    "$BIN/server_test" "$PORT" > server.out 2>&1 &
+    SP=$!
+    sleep 0.3
+    SHAM_ISN=$ISN "$BIN/client_test" 127.0.0.1 "$PORT" "$1" "$2" > client.out 2>&1
+    local rc=$?
+    wait $SP
+    [ $rc -eq 0 ] || { cat client.out server.out; fail "client exited with $rc"; }
+}
+
+# 1. Small logged transfer: the data sequence numbers must cross 2^32
+head -c 200000 /dev/urandom > wrap.bin
+RUDP_LOG=1 transfer wrap.bin wrap.out
+[ "$(md5sum < wrap.bin)" = "$(md5sum < wrap.out)" ] || fail "MD5 mismatch after sequence wrap"
+grep -q "SND DATA SEQ=$((ISN + 1)) " client_log.txt || fail "client did not start at ISN $ISN"
+grep -Eq "SND DATA SEQ=[0-9]{1,6} " client_log.txt || fail "sequence numbers did not wrap"
+echo "wrap: OK (ISN $ISN, sequence crossed 2^32)"
+rm -f wrap.out client_log.txt server_log.txt
+
+# 2. The large file: sparse, with random blocks so a misplaced segment shows
+truncate -s "$SIZE" big.bin || fail "truncate failed"
+bytes=$(stat -c %s big.bin)
+[ "$bytes" -gt 4294967296 ] || fail "size $SIZE is not above 4 GiB"
+for mb in 0 1024 2048 4095 4097 $((bytes / 1048576 - 1)); do
+    dd if=/dev/urandom of=big.bin bs=1M count=1 seek="$mb" conv=notrunc status=none
+done
+
+transfer big.bin big.out
+grep -E "^Sent|^OK" client.out
+src=$(md5sum < big.bin | cut -d' ' -f1)
+dst=$(md5sum < big.out | cut -d' ' -f1)
+[ "$src" = "$dst" ] || fail "MD5 mismatch: $src vs $dst"
+echo "large: OK ($bytes bytes, MD5 $src)"
+
+mbps=$(sed -n 's/.*goodput \([0-9.]*\) Mbps.*/\1/p' client.out | head -1)
+[ -n "$mbps" ] || fail "no goodput reported"
+awk -v m="$mbps" -v min="$MIN_MBPS" 'BEGIN { exit !(m >= min) }' || fail "goodput $mbps Mbps below $MIN_MBPS"
+echo "PASS: goodput $mbps Mbps"